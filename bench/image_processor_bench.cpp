@@ -0,0 +1,296 @@
+#include "executor.h"
+#include "filter.h"
+#include "image.h"
+#include "reader.h"
+#include "thread_pool.h"
+#include "writer.h"
+#include <sys/resource.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <optional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdexcept>
+
+// Measures the reader, the writer, every filter and a few representative chains on synthetic
+// images and prints one machine-readable record per case.
+
+namespace {
+constexpr size_t KDefaultRepeats = 3;
+constexpr double KNanosecondsPerSecond = 1e9;
+constexpr double KPixelsPerMegapixel = 1e6;
+constexpr size_t KBytesPerKilobyte = 1024;
+
+struct Size {
+    size_t width;
+    size_t height;
+};
+
+// Square, wide and tall images; the odd widths leave 1-3 padding bytes per BMP row.
+const std::vector<Size> KQuickSizes = {{256, 256}, {1023, 767}, {1920, 1080}, {1081, 1921}, {4096, 4096}};
+const std::vector<Size> KFullSizes = {{256, 256},   {1023, 767},  {1920, 1080},  {1081, 1921},
+                                      {4096, 4096}, {8191, 4097}, {16384, 16384}};
+
+struct Case {
+    std::string name;
+    std::function<std::vector<FilterPtr>(Size)> make_filters;
+};
+
+const std::vector<Case>& FilterCases() {
+    static const std::vector<Case> cases = {
+        {"neg", [](Size) { return std::vector<FilterPtr>{CreateNegativeFilter()}; }},
+        {"gs", [](Size) { return std::vector<FilterPtr>{CreateGrayscaleFilter()}; }},
+        {"sepia", [](Size) { return std::vector<FilterPtr>{CreateSepiaFilter()}; }},
+        {"crop",
+         [](Size size) { return std::vector<FilterPtr>{CreateCropFilter(size.width / 2, size.height / 2)}; }},
+        {"sharp", [](Size) { return std::vector<FilterPtr>{CreateSharpeningFilter()}; }},
+        {"edge 0.1", [](Size) { return std::vector<FilterPtr>{CreateEdgeDetectionFilter(0.1f)}; }},
+        {"blur 2", [](Size) { return std::vector<FilterPtr>{CreateGaussianBlurFilter(2.0f)}; }},
+        {"blur 10", [](Size) { return std::vector<FilterPtr>{CreateGaussianBlurFilter(10.0f)}; }},
+        {"crop neg gs",
+         [](Size size) {
+             return std::vector<FilterPtr>{CreateCropFilter(size.width / 2, size.height / 2), CreateNegativeFilter(),
+                                           CreateGrayscaleFilter()};
+         }},
+        {"gs neg sepia",
+         [](Size) {
+             return std::vector<FilterPtr>{CreateGrayscaleFilter(), CreateNegativeFilter(), CreateSepiaFilter()};
+         }},
+        {"blur 3 sharp edge 0.2",
+         [](Size) {
+             return std::vector<FilterPtr>{CreateGaussianBlurFilter(3.0f), CreateSharpeningFilter(),
+                                           CreateEdgeDetectionFilter(0.2f)};
+         }},
+    };
+    return cases;
+}
+
+struct Options {
+    std::vector<Size> sizes = KQuickSizes;
+    size_t repeats = KDefaultRepeats;
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    std::string format = "json";
+    std::string output;
+    std::string filter;
+};
+
+struct Record {
+    std::string name;
+    Size size;
+    size_t threads;
+    double seconds;
+    size_t peak_rss;
+};
+
+// Smooth gradients with a little noise, so that no filter sees a degenerate flat image.
+Image MakeImage(Size size) {
+    Image image(size.width, size.height, PixelLayout::Planar);
+    uint32_t state = 0x9E3779B9u;
+    for (size_t y = 0; y < size.height; ++y) {
+        float* r = image.ChannelRow(0, y);
+        float* g = image.ChannelRow(1, y);
+        float* b = image.ChannelRow(2, y);
+        for (size_t x = 0; x < size.width; ++x) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            const float noise = static_cast<float>(state & 0xFF) / 255.0f * 0.25f;
+            r[x] = std::min(1.0f, static_cast<float>(x) / static_cast<float>(size.width) * 0.75f + noise);
+            g[x] = std::min(1.0f, static_cast<float>(y) / static_cast<float>(size.height) * 0.75f + noise);
+            b[x] = std::min(1.0f, static_cast<float>((x + y) % 256) / 255.0f * 0.75f + noise);
+        }
+    }
+    return image;
+}
+
+// Linux can reset the high-water mark, which gives a peak per case; elsewhere the process peak is reported.
+void ResetPeakRss() {
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    if (clear_refs.is_open()) {
+        clear_refs << "5";
+    }
+}
+
+size_t GetPeakRss() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind("VmHWM:", 0) == 0) {
+            return std::stoul(line.substr(line.find_first_of("0123456789"))) * KBytesPerKilobyte;
+        }
+    }
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<size_t>(usage.ru_maxrss) * KBytesPerKilobyte;
+}
+
+// Runs prepare + body repeats times and keeps the fastest body time; prepare is not timed.
+Record Measure(const std::string& name, Size size, size_t threads, size_t repeats,
+               const std::function<void()>& prepare, const std::function<void()>& body) {
+    double best = 0.0;
+    ResetPeakRss();
+    for (size_t i = 0; i < repeats; ++i) {
+        prepare();
+        const auto start = std::chrono::steady_clock::now();
+        body();
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = i == 0 ? seconds : std::min(best, seconds);
+    }
+    return {name, size, threads, best, GetPeakRss()};
+}
+
+std::vector<Size> ParseSizes(const std::string& text) {
+    if (text == "quick") {
+        return KQuickSizes;
+    }
+    if (text == "full") {
+        return KFullSizes;
+    }
+    std::vector<Size> sizes;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        const size_t separator = item.find('x');
+        if (separator == std::string::npos) {
+            throw std::runtime_error("Size must look like WxH: " + item);
+        }
+        sizes.push_back({std::stoul(item.substr(0, separator)), std::stoul(item.substr(separator + 1))});
+    }
+    return sizes;
+}
+
+Options ParseOptions(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            throw std::runtime_error("Missing value for option " + arg);
+        }
+        const std::string value = argv[++i];
+        if (arg == "--sizes") {
+            options.sizes = ParseSizes(value);
+        } else if (arg == "--repeats") {
+            options.repeats = std::max<size_t>(1, std::stoul(value));
+        } else if (arg == "--threads") {
+            options.threads = std::max<size_t>(1, std::stoul(value));
+        } else if (arg == "--format") {
+            if (value != "json" && value != "csv") {
+                throw std::runtime_error("--format must be json or csv");
+            }
+            options.format = value;
+        } else if (arg == "--output") {
+            options.output = value;
+        } else if (arg == "--filter") {
+            options.filter = value;
+        } else {
+            throw std::runtime_error("Unknown option: " + arg);
+        }
+    }
+    return options;
+}
+
+void Print(const std::vector<Record>& records, const std::string& format, std::ostream& out) {
+    if (format == "csv") {
+        out << "name,width,height,threads,seconds,megapixels_per_second,ns_per_pixel,peak_rss_bytes\n";
+    } else {
+        out << "[\n";
+    }
+    for (size_t i = 0; i < records.size(); ++i) {
+        const Record& record = records[i];
+        const double pixels = static_cast<double>(record.size.width * record.size.height);
+        const double mp_per_s = pixels / record.seconds / KPixelsPerMegapixel;
+        const double ns_per_pixel = record.seconds * KNanosecondsPerSecond / pixels;
+        if (format == "csv") {
+            out << '"' << record.name << "\"," << record.size.width << ',' << record.size.height << ','
+                << record.threads << ',' << record.seconds << ',' << mp_per_s << ',' << ns_per_pixel << ','
+                << record.peak_rss << '\n';
+        } else {
+            out << "  {\"name\": \"" << record.name << "\", \"width\": " << record.size.width
+                << ", \"height\": " << record.size.height << ", \"threads\": " << record.threads
+                << ", \"seconds\": " << record.seconds << ", \"megapixels_per_second\": " << mp_per_s
+                << ", \"ns_per_pixel\": " << ns_per_pixel << ", \"peak_rss_bytes\": " << record.peak_rss << "}"
+                << (i + 1 < records.size() ? "," : "") << '\n';
+        }
+    }
+    if (format != "csv") {
+        out << "]\n";
+    }
+}
+
+std::vector<Record> RunBenchmarks(const Options& options) {
+    ThreadPool pool(options.threads);
+    Executor executor(pool);
+    const std::string path =
+        (std::filesystem::temp_directory_path() / ("image_processor_bench_" + std::to_string(getpid()) + ".bmp"))
+            .string();
+    const auto selected = [&options](const std::string& name) {
+        return options.filter.empty() || name.find(options.filter) != std::string::npos;
+    };
+
+    std::vector<Record> records;
+    for (const Size size : options.sizes) {
+        std::cerr << "Benchmarking " << size.width << "x" << size.height << "\n";
+        const Image source = MakeImage(size);
+
+        if (selected("write")) {
+            records.push_back(Measure("write", size, 1, options.repeats, [] {},
+                                      [&] { writer::GetBMPWriter(path)->Write(source); }));
+        } else {
+            writer::GetBMPWriter(path)->Write(source);
+        }
+        if (selected("read")) {
+            records.push_back(Measure("read", size, 1, options.repeats, [] {},
+                                      [&] { reader::GetBMPReader(path)->GetImage(); }));
+        }
+
+        for (const Case& filter_case : FilterCases()) {
+            if (!selected(filter_case.name)) {
+                continue;
+            }
+            const std::vector<FilterPtr> filters = filter_case.make_filters(size);
+            std::optional<Image> image;
+            records.push_back(Measure(
+                filter_case.name, size, options.threads, options.repeats,
+                [&] {
+                    image.reset();
+                    image = reader::GetBMPReader(path, Executor::GetInputFormat(filters))->GetImage();
+                },
+                [&] { executor.Run(*image, filters); }));
+        }
+    }
+    std::filesystem::remove(path);
+    return records;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+    try {
+        const Options options = ParseOptions(argc, argv);
+        const std::vector<Record> records = RunBenchmarks(options);
+        if (options.output.empty()) {
+            Print(records, options.format, std::cout);
+        } else {
+            std::ofstream file(options.output);
+            if (!file.is_open()) {
+                throw std::runtime_error("Failed to create output file: " + options.output);
+            }
+            Print(records, options.format, file);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n"
+                  << "Usage: " << argv[0]
+                  << " [--sizes quick|full|WxH,...] [--repeats N] [--threads N] [--format json|csv]"
+                     " [--output FILE] [--filter SUBSTRING]\n";
+        return 1;
+    }
+    return 0;
+}
@@ -3,25 +3,38 @@
 #include <string>
 #include <vector>
 #include "filter.h"
+#include "filter_registry.h"
 
+// Parses "<input> <output> [-filter [params]]..." against the FilterRegistry. The whole chain
+// is validated before anything is built, so a mistake anywhere on the line is reported before
+// any file is touched.
 class ArgParser {
 public:
     ArgParser(int argc, char** argv);
 
-    std::string GetInputPath() const {
+    const std::string& GetInputPath() const {
         return input_path_;
     }
-    std::string GetOutputPath() const {
+    const std::string& GetOutputPath() const {
         return output_path_;
     }
-    std::vector<FilterPtr> GetFilters() const {
+    const std::vector<FilterPtr>& GetFilters() const {
         return filters_;
     }
+    // The filters again, with the metadata planning needs.
+    const std::vector<FilterStage>& GetPipeline() const {
+        return pipeline_;
+    }
+    // Every filter as its switch and parameters spelled canonically, such as "-blur 2", so that
+    // command lines building the same chain give the same strings.
+    const std::vector<std::string>& GetCanonicalStages() const {
+        return canonical_stages_;
+    }
 
 private:
-    void ParseFilters(int& i, int argc, char** argv);
-
     std::string input_path_;
     std::string output_path_;
     std::vector<FilterPtr> filters_;
+    std::vector<FilterStage> pipeline_;
+    std::vector<std::string> canonical_stages_;
 };
\ No newline at end of file
@@ -0,0 +1,44 @@
+#pragma once
+#include "filter.h"
+#include "thread_pool.h"
+#include <string>
+#include <utility>
+#include <vector>
+
+struct BatchJob {
+    std::string input;
+    std::string output;
+};
+
+struct BatchSummary {
+    size_t succeeded = 0;
+    size_t pixels = 0;
+    double seconds = 0.0;
+    // Input path and error message of every file that could not be processed.
+    std::vector<std::pair<std::string, std::string>> failures;
+};
+
+// Jobs listed in a manifest: one input path per line, optionally followed by a tab and the
+// output path. Empty lines and lines starting with '#' are skipped. Outputs that are not given
+// or are relative are placed in output_dir. Throws if two lines name the same output.
+std::vector<BatchJob> ReadBatchManifest(const std::string& manifest, const std::string& output_dir);
+
+// Jobs for the regular files in directory whose names match the shell pattern glob, sorted by
+// name; each output keeps the input file name and is placed in output_dir.
+std::vector<BatchJob> ListBatchDirectory(const std::string& directory, const std::string& glob,
+                                         const std::string& output_dir);
+
+// Runs one filter chain over many files. Files are read, filtered and written as independent
+// tasks on the pool, so one file's I/O overlaps the other files' compute. A file that fails is
+// recorded in the summary and does not stop the rest of the batch. With direct_io BMP outputs
+// are written with O_DIRECT, as by GetBMPWriter.
+class BatchProcessor {
+public:
+    explicit BatchProcessor(ThreadPool& pool, bool direct_io = false);
+
+    BatchSummary Run(const std::vector<BatchJob>& jobs, const std::vector<FilterPtr>& filters);
+
+private:
+    ThreadPool& pool_;
+    bool direct_io_;
+};
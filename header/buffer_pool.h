@@ -0,0 +1,46 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Recycles the large, 64-byte aligned buffers that images are made of. Requests are rounded up
+// to size buckets a quarter of a power of two apart, so images of similar sizes share buffers
+// while at most 25% of a buffer is wasted. Buffers come back uninitialised.
+class BufferPool {
+public:
+    struct Stats {
+        size_t requests = 0;
+        size_t hits = 0;
+        // Bytes obtained from the system, i.e. by requests that missed.
+        size_t allocated_bytes = 0;
+        size_t cached_bytes = 0;
+    };
+
+    static constexpr size_t KAlignment = 64;
+    // Released buffers beyond this many cached bytes are returned to the system.
+    static constexpr size_t KMaxCachedBytes = size_t{2} << 30;
+
+    static BufferPool& GetInstance();
+
+    BufferPool() = default;
+    ~BufferPool();
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // Returns a buffer of at least GetBucketSize(bytes) bytes.
+    uint8_t* Acquire(size_t bytes);
+    // bytes must be the size the buffer was acquired with.
+    void Release(uint8_t* data, size_t bytes);
+
+    Stats GetStats() const;
+
+    static size_t GetBucketSize(size_t bytes);
+
+private:
+    mutable std::mutex mutex_;
+    std::unordered_map<size_t, std::vector<uint8_t*>> free_;
+    Stats stats_;
+};
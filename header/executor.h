@@ -0,0 +1,34 @@
+#pragma once
+#include "filter.h"
+#include "image.h"
+#include "thread_pool.h"
+#include <optional>
+#include <vector>
+
+// Runs a filter chain on a thread pool. Row and resample filters are split into bands of output
+// rows that are processed independently; every band produces exactly the rows the serial path
+// would.
+class Executor {
+public:
+    explicit Executor(ThreadPool& pool);
+
+    // Images in a format a filter does not accept are promoted to Float32 before it runs.
+    void Run(Image& image, const std::vector<FilterPtr>& filters);
+
+    // The narrowest format the chain can start from and still give the same output as Float32:
+    // UInt8 when every filter accepts it and the output of every filter that is followed by
+    // anything but crops already lies on the 8-bit grid. Unless the output is rounded to 8 bits
+    // anyway, the last filter's output counts as well.
+    static PixelFormat GetInputFormat(const std::vector<FilterPtr>& filters, bool byte_output = true);
+
+    // The top-left window that is all the chain ever reads of its input: the intersection of the
+    // crops that come before any filter other than point filters, which commute with them.
+    // Nullopt if the whole image is needed.
+    static std::optional<CropWindow> GetInputWindow(const std::vector<FilterPtr>& filters);
+
+private:
+    void RunBands(Image& image, const RowFilter& filter);
+    void RunResample(Image& image, const ResampleFilter& filter);
+
+    ThreadPool& pool_;
+};
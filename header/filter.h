@@ -1,19 +1,154 @@
 #pragma once
 #include "image.h"
 #include <memory>
+#include <string>
+#include <vector>
+
+// Per-pixel colour transform: v = matrix * (r, g, b) + offset, rounded to the nearest of the
+// 256 8-bit levels when quantize is set, then saturated to [0, 1].
+struct PointOp {
+    float matrix[3][3];
+    float offset[3];
+    bool quantize;
+};
+
+// Top-left part of the image that a crop keeps; larger sizes are limited to the image.
+struct CropWindow {
+    size_t width;
+    size_t height;
+};
 
 class IFilter {
 public:
     virtual ~IFilter() = default;
     virtual void Apply(Image& image) const = 0;
+
+    // Short human-readable name, used in profiles and error messages.
+    virtual std::string GetName() const = 0;
+
+    // The transform of a filter that maps every pixel independently, nullptr for other filters.
+    virtual const PointOp* GetPointOp() const {
+        return nullptr;
+    }
+
+    // The kept window of a filter that only cuts the image, nullptr for other filters.
+    virtual const CropWindow* GetCropWindow() const {
+        return nullptr;
+    }
+
+    // Pixel formats Apply works on directly; images in other formats are promoted to Float32.
+    virtual bool Accepts(PixelFormat format) const {
+        return format == PixelFormat::Float32;
+    }
+
+    // True if every output value is one of the 256 8-bit levels, so storing it as UInt8 loses nothing.
+    virtual bool KeepsByteGrid() const {
+        return false;
+    }
+};
+
+// A filter that keeps the image size and computes every output row from the input rows
+// within GetRadius() of it, so the image can be split into independent row bands.
+class RowFilter : public IFilter {
+public:
+    void Apply(Image& image) const override;
+
+    // Number of rows above and below an output row the filter reads.
+    virtual size_t GetRadius() const = 0;
+
+    // Writes rows [begin, end) of dst. Reads outside src are clamped to its border.
+    // src is planar. dst has the same size and is either the same image, when GetRadius() is
+    // zero, one from CreateOutput(src), or planar in the format of src.
+    virtual void ApplyRows(const Image& src, Image& dst, size_t begin, size_t end) const = 0;
+
+    // The image the whole output is written into when GetRadius() is not zero: planar in the
+    // format of src unless the filter knows a smaller representation of its result.
+    virtual Image CreateOutput(const Image& src) const;
+};
+
+// Input rows [first, last).
+struct RowSpan {
+    size_t first;
+    size_t last;
+};
+
+// A resample of one input size, with its weights computed once. ApplyRows may run concurrently
+// on disjoint output rows.
+class ResamplePlan {
+public:
+    virtual ~ResamplePlan() = default;
+
+    // Size of the output.
+    virtual size_t GetWidth() const = 0;
+    virtual size_t GetHeight() const = 0;
+
+    // Input rows that output rows [begin, end) read. Both ends never decrease as the output
+    // range moves down.
+    virtual RowSpan GetInputRows(size_t begin, size_t end) const = 0;
+
+    // Writes output rows [begin, end) to the rows of dst from dst_y on. Row i of src holds input
+    // row src_y + i, and src holds at least GetInputRows(begin, end). Both are planar Float32.
+    virtual void ApplyRows(const Image& src, size_t src_y, Image& dst, size_t dst_y, size_t begin,
+                           size_t end) const = 0;
+};
+
+// A filter that changes the image size. Every output row depends on a contiguous range of input
+// rows only, so output rows can be computed in independent bands and streamed.
+class ResampleFilter : public IFilter {
+public:
+    void Apply(Image& image) const override;
+
+    virtual std::unique_ptr<ResamplePlan> Prepare(size_t width, size_t height) const = 0;
+};
+
+// Applies a sequence of point operations in a single pass over the image. UInt8 pixels are
+// widened to floats for the pass and rounded back only once at the end.
+class PointFilter : public RowFilter {
+public:
+    PointFilter(std::vector<PointOp> stages, std::string name);
+
+    std::string GetName() const override {
+        return name_;
+    }
+
+    const PointOp* GetPointOp() const override {
+        return stages_.size() == 1 ? &stages_.front() : nullptr;
+    }
+
+    bool Accepts(PixelFormat format) const override {
+        return format == PixelFormat::Float32 || format == PixelFormat::UInt8;
+    }
+
+    bool KeepsByteGrid() const override {
+        return stages_.back().quantize;
+    }
+
+    size_t GetRadius() const override {
+        return 0;
+    }
+
+    void ApplyRows(const Image& src, Image& dst, size_t begin, size_t end) const override;
+
+private:
+    std::vector<PointOp> stages_;
+    std::string name_;
 };
 
 using FilterPtr = std::shared_ptr<IFilter>;
 
+// Replaces every run of adjacent point filters with one PointFilter. Stages are multiplied
+// into a single matrix where the saturation between them cannot clip inputs in [0, 1]; such a
+// product skips the intermediate float rounding and may differ from separate passes by one
+// 8-bit level on rare pixels. Runs that cannot be collapsed give bit-identical results.
+std::vector<FilterPtr> FusePointFilters(const std::vector<FilterPtr>& filters);
+
 FilterPtr CreateGrayscaleFilter();
 FilterPtr CreateNegativeFilter();
 FilterPtr CreateCropFilter(size_t width, size_t height);
 FilterPtr CreateSharpeningFilter();
 FilterPtr CreateEdgeDetectionFilter(float threshold);
 FilterPtr CreateGaussianBlurFilter(float sigma);
-FilterPtr CreateSepiaFilter();
\ No newline at end of file
+FilterPtr CreateSepiaFilter();
+FilterPtr CreateResizeFilter(size_t width, size_t height);
+// Scales both sides by factor, rounded to whole pixels and at least one.
+FilterPtr CreateScaleFilter(float factor);
@@ -0,0 +1,79 @@
+#pragma once
+#include "filter.h"
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+enum class ParamType { Integer, Real };
+
+// One positional parameter of a filter; values outside [min, max] are rejected when parsing.
+struct ParamSpec {
+    std::string name;
+    ParamType type;
+    double min;
+    double max;
+};
+
+// Everything the command line needs to know to build a filter.
+struct FilterSpec {
+    // The command-line switch, such as "-blur".
+    std::string flag;
+    std::string description;
+    std::vector<ParamSpec> params;
+    // Called with one validated value per parameter.
+    std::function<FilterPtr(const std::vector<double>&)> factory;
+};
+
+// How a filter reads its input, which decides how a chain can be fused, split into bands or
+// streamed.
+enum class FilterKind {
+    // Every output pixel depends on the same input pixel only.
+    Point,
+    // Cuts the image to a top-left window.
+    Crop,
+    // Every output row depends on the input rows within the radius.
+    Neighbourhood,
+    // Changes the size; every output row depends on a contiguous range of input rows.
+    Resample,
+    // Needs the whole image at once.
+    Global,
+};
+
+// Planning metadata of one step of a chain, read off the filter itself.
+struct FilterStage {
+    FilterPtr filter;
+    FilterKind kind;
+    // Rows above and below an output row that the filter reads; zero unless Neighbourhood.
+    size_t radius;
+    // The formats the filter works on directly.
+    std::vector<PixelFormat> formats;
+    bool keeps_byte_grid;
+};
+
+FilterStage DescribeFilter(const FilterPtr& filter);
+const char* GetFilterKindName(FilterKind kind);
+const char* GetPixelFormatName(PixelFormat format);
+
+// Maps command-line switches to filter factories. The built-in filters are registered when the
+// instance is first used; Register is meant for start-up and is not synchronised.
+class FilterRegistry {
+public:
+    static FilterRegistry& GetInstance();
+
+    // Throws std::invalid_argument if the flag is taken.
+    void Register(FilterSpec spec);
+
+    // nullptr for unknown flags.
+    const FilterSpec* Find(const std::string& flag) const;
+
+    // In registration order.
+    const std::vector<FilterSpec>& GetSpecs() const {
+        return specs_;
+    }
+
+private:
+    FilterRegistry();
+
+    std::vector<FilterSpec> specs_;
+};
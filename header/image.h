@@ -1,4 +1,8 @@
 #pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
 #include <vector>
 #include <stdexcept>
 
@@ -8,10 +12,64 @@ struct Pixel {
     float b = 0.0f;
 };
 
+// Interleaved stores rows of Pixel; Planar stores one plane per channel (r, g, b). Mono stores a
+// single plane that all three channels read, for images whose channels are equal such as masks;
+// filters see it expanded to Planar, writers expand it a row at a time.
+enum class PixelLayout { Interleaved, Planar, Mono };
+
+// Channel element type. Float32 holds values in [0, 1]; the integer formats hold the full
+// 0-255 / 0-65535 range and are planar only.
+enum class PixelFormat { Float32, UInt16, UInt8 };
+
+// Conversions between channel representations, shared by format conversion and the codecs.
+namespace pixel {
+constexpr float KByteMax = 255.0f;
+constexpr float KWordMax = 65535.0f;
+constexpr float KRoundingOffset = 0.5f;
+
+inline float FromByte(uint8_t value) {
+    return static_cast<float>(value) / KByteMax;
+}
+inline float FromWord(uint16_t value) {
+    return static_cast<float>(value) / KWordMax;
+}
+inline uint8_t ToByte(float value) {
+    return static_cast<uint8_t>(std::clamp(value * KByteMax, 0.0f, KByteMax) + KRoundingOffset);
+}
+inline uint16_t ToWord(float value) {
+    return static_cast<uint16_t>(std::clamp(value * KWordMax, 0.0f, KWordMax) + KRoundingOffset);
+}
+}  // namespace pixel
+
+// Pixels are kept in one buffer whose rows start on 64-byte boundaries. Row(), Channel()
+// and ChannelRow() give unchecked access for kernels; GetPixel/SetPixel check coordinates
+// and convert integer formats to and from floats. Crop() turns the image into a view of a
+// window of its buffer, so rows keep the stride of the full buffer.
 class Image {
 public:
-    Image(size_t width, size_t height);
+    static constexpr size_t KChannels = 3;
+    static constexpr size_t KRowAlignment = 64;
+
+    // Gives an adopted buffer back to whoever created it.
+    using BufferRelease = void (*)(uint8_t* data, size_t bytes);
+
+    // Pixels start out black.
+    Image(size_t width, size_t height, PixelLayout layout = PixelLayout::Interleaved,
+          PixelFormat format = PixelFormat::Float32);
+    // For images whose every pixel is about to be written: the buffer is not cleared.
+    static Image CreateUninitialized(size_t width, size_t height, PixelLayout layout = PixelLayout::Planar,
+                                     PixelFormat format = PixelFormat::Float32);
     Image(size_t width, size_t height, const std::vector<std::vector<Pixel>>& data);
+    // Wraps a planar buffer of the given size without copying it. The buffer must be laid out
+    // like the ones images allocate themselves: GetRowBytes() per row, the planes back to back.
+    // release(data, bytes) is called once the image no longer uses it.
+    static Image Adopt(size_t width, size_t height, PixelFormat format, uint8_t* data, size_t bytes,
+                       BufferRelease release);
+
+    Image(const Image& other);
+    Image& operator=(const Image& other);
+    Image(Image&& other) noexcept = default;
+    Image& operator=(Image&& other) noexcept = default;
 
     size_t GetWidth() const {
         return width_;
@@ -19,12 +77,84 @@ public:
     size_t GetHeight() const {
         return height_;
     }
+    PixelLayout GetLayout() const {
+        return layout_;
+    }
+    PixelFormat GetFormat() const {
+        return format_;
+    }
+    static size_t GetElementSize(PixelFormat format);
+    // Distance in bytes between rows of the buffers images of this width allocate.
+    static size_t GetRowBytes(size_t width, PixelLayout layout, PixelFormat format);
+    // Distance in elements between the starts of consecutive rows (of one plane for Planar).
+    size_t GetStride() const {
+        return row_bytes_ / GetElementSize(format_);
+    }
+
+    // Interleaved Float32 images only.
+    Pixel* Row(size_t y) {
+        return reinterpret_cast<Pixel*>(origin_ + y * row_bytes_);
+    }
+    const Pixel* Row(size_t y) const {
+        return reinterpret_cast<const Pixel*>(origin_ + y * row_bytes_);
+    }
+
+    // Planar and Mono images only; channel 0 is red, 1 is green, 2 is blue. T is the element type
+    // of the format, or uint8_t for the raw bytes of any format. Rows of a channel are GetStride()
+    // elements apart. The channels of a Mono image are the same plane, so it is read-only here.
+    template <typename T = float>
+    T* Channel(size_t c) {
+        return ChannelRow<T>(c, 0);
+    }
+    template <typename T = float>
+    const T* Channel(size_t c) const {
+        return ChannelRow<T>(c, 0);
+    }
+    template <typename T = float>
+    T* ChannelRow(size_t c, size_t y) {
+        return reinterpret_cast<T*>(origin_ + c * channel_bytes_ + y * row_bytes_);
+    }
+    template <typename T = float>
+    const T* ChannelRow(size_t c, size_t y) const {
+        return reinterpret_cast<const T*>(origin_ + c * channel_bytes_ + y * row_bytes_);
+    }
+
+    // Convert the pixel storage in place; they do nothing if the image already matches. A Mono
+    // image keeps its layout when its format changes, and no image can be converted to Mono.
+    void SetLayout(PixelLayout layout);
+    void SetFormat(PixelFormat format);
+
+    // Restricts the image to the window at (x, y) in O(1); the rest of the buffer stays allocated
+    // until the image is replaced. Rows stay 64-byte aligned when x is zero. Copies of a cropped
+    // image hold the window only.
+    void Crop(size_t x, size_t y, size_t width, size_t height);
 
     Pixel GetPixel(size_t x, size_t y) const;
     void SetPixel(size_t x, size_t y, const Pixel& pixel);
 
 private:
+    // Hands the buffer back to the BufferPool, or to its owner if it was adopted.
+    struct BufferDeleter {
+        size_t bytes;
+        BufferRelease release;
+        void operator()(uint8_t* data) const;
+    };
+
+    Image(size_t width, size_t height, PixelLayout layout, PixelFormat format, bool clear);
+    Image(size_t width, size_t height, PixelLayout layout, PixelFormat format, uint8_t* data,
+          BufferDeleter deleter);
+
+    size_t BufferSize() const;
+    size_t RowBytes() const;
+
     size_t width_;
     size_t height_;
-    std::vector<Pixel> data_;
-};
\ No newline at end of file
+    PixelLayout layout_;
+    PixelFormat format_;
+    size_t row_bytes_;
+    size_t plane_bytes_;
+    // Distance between the planes of consecutive channels: zero for Mono.
+    size_t channel_bytes_;
+    std::unique_ptr<uint8_t[], BufferDeleter> data_;
+    uint8_t* origin_;
+};
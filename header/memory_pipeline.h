@@ -0,0 +1,36 @@
+#pragma once
+#include "filter.h"
+#include "image.h"
+#include "thread_pool.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Runs one filter chain on BMP files held in memory, for programs that link the library
+// instead of calling the executable. The chain is parsed and its filters built once; Run may
+// be called from several threads at once.
+class MemoryPipeline {
+public:
+    // chain is spelled as on the command line, such as {"-crop", "800", "600", "-blur", "2"}.
+    // threads is the size of the pool the images are split across; zero means one per core.
+    explicit MemoryPipeline(const std::vector<std::string>& chain, size_t threads = 0);
+    ~MemoryPipeline();
+
+    // Decodes size bytes of a BMP file and applies the chain.
+    Image Filter(const uint8_t* data, size_t size) const;
+
+    // Filters and encodes the result as a 24-bit BMP file.
+    std::vector<uint8_t> Run(const uint8_t* data, size_t size) const;
+    // Encodes straight into output and returns the number of bytes written. Throws
+    // std::length_error if capacity is less than writer::GetBMPFileSize of the result.
+    size_t Run(const uint8_t* data, size_t size, uint8_t* output, size_t capacity) const;
+
+private:
+    std::vector<FilterPtr> filters_;
+    PixelFormat format_;
+    std::optional<CropWindow> window_;
+    std::unique_ptr<ThreadPool> pool_;
+};
@@ -0,0 +1,39 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// File descriptor with positional reads and writes, which never move a shared file offset
+// and so can be issued from several threads at once.
+class PosixFile {
+public:
+    PosixFile(const std::string& path, int flags, unsigned mode = 0644);
+    ~PosixFile();
+
+    PosixFile(const PosixFile&) = delete;
+    PosixFile& operator=(const PosixFile&) = delete;
+
+    int GetDescriptor() const {
+        return fd_;
+    }
+    size_t GetSize() const;
+
+    // Both throw unless exactly size bytes were transferred.
+    void ReadAt(void* data, size_t size, uint64_t offset) const;
+    void WriteAt(const void* data, size_t size, uint64_t offset) const;
+
+    // Sets the file length, reserving the blocks up front where the file system allows it.
+    void Allocate(uint64_t size) const;
+    void Truncate(uint64_t size) const;
+
+private:
+    std::string path_;
+    int fd_;
+};
+
+// Whether both paths name the same existing file, links included.
+bool IsSameFile(const std::string& first, const std::string& second);
+
+// An unused name in the directory of path that keeps its extension, for writing a file that is
+// then renamed over path.
+std::string MakeTemporaryPath(const std::string& path);
@@ -0,0 +1,80 @@
+#pragma once
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+struct ProfileEvent {
+    std::string name;
+    double start_us;
+    double wall_us;
+    // CPU time of the whole process, so work done by pool threads counts towards the stage.
+    double cpu_us;
+    size_t pixels;
+    // Bytes of image buffers newly allocated (buffer pool misses) while the stage ran.
+    size_t bytes_allocated;
+    size_t thread;
+};
+
+// Collects timed stages of a run. Nothing is recorded unless a profiler has been activated,
+// and an inactive ProfileScope costs a single pointer check: names are only copied, or built,
+// once there is a profiler to report to.
+class Profiler {
+public:
+    Profiler();
+
+    // The profiler scopes report to; nullptr disables profiling. Set before the work starts.
+    static Profiler* GetActive();
+    static void SetActive(Profiler* profiler);
+
+    // Called for every image buffer taken from the system; cheap enough to stay on when profiling is off.
+    static void CountAllocation(size_t bytes);
+    static size_t GetAllocatedBytes();
+
+    double GetElapsedMicroseconds() const;
+    void Record(ProfileEvent event);
+
+    // One row per stage name with the totals of all its events.
+    void PrintTable(std::ostream& out) const;
+    // Chrome trace-event JSON, loadable in chrome://tracing or Perfetto.
+    void WriteChromeTrace(std::ostream& out) const;
+
+private:
+    const double start_us_;
+    mutable std::mutex mutex_;
+    std::vector<ProfileEvent> events_;
+    std::vector<std::thread::id> threads_;
+};
+
+// Records the lifetime of the scope as a stage of the active profiler, if there is one.
+class ProfileScope {
+public:
+    explicit ProfileScope(const char* name, size_t pixels = 0);
+    // For names that take work to build, such as filter names: get_name() is only called when
+    // profiling is on.
+    template <typename GetName, typename = std::enable_if_t<std::is_invocable_r_v<std::string, GetName>>>
+    ProfileScope(GetName get_name, size_t pixels) : ProfileScope(static_cast<const char*>(nullptr), pixels) {
+        if (profiler_ != nullptr) {
+            name_ = get_name();
+        }
+    }
+    ~ProfileScope();
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+    // For stages that only learn the image size while they run.
+    void SetPixels(size_t pixels) {
+        pixels_ = pixels;
+    }
+
+private:
+    Profiler* profiler_;
+    std::string name_;
+    size_t pixels_;
+    double start_us_ = 0.0;
+    double start_cpu_us_ = 0.0;
+    size_t start_bytes_ = 0;
+};
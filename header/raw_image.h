@@ -0,0 +1,40 @@
+#pragma once
+#include "image.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Uncompressed intermediate files ("*.raw") that keep the pixel format of the image, so chained
+// runs lose no precision between stages. A one-page header is followed by the three channel
+// planes laid out exactly like an Image buffer, which lets the reader map the pixels instead of
+// decoding them.
+namespace raw_image {
+
+constexpr char KMagic[8] = {'I', 'P', 'R', 'A', 'W', 'I', 'M', 'G'};
+constexpr uint32_t KVersion = 1;
+// Pixel data starts on a page boundary, where it can be mapped.
+constexpr size_t KDataOffset = 4096;
+constexpr char KExtension[] = ".raw";
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    // 0 for Float32, 1 for UInt16, 2 for UInt8.
+    uint32_t format;
+    uint64_t width;
+    uint64_t height;
+    // Distance between rows of a plane; planes are height * row_bytes apart.
+    uint64_t row_bytes;
+    uint64_t data_offset;
+};
+
+inline bool IsRawPath(const std::string& path) {
+    const size_t length = sizeof(KExtension) - 1;
+    return path.size() > length && path.compare(path.size() - length, length, KExtension) == 0;
+}
+
+inline uint64_t GetPlaneBytes(const Header& header) {
+    return header.row_bytes * header.height;
+}
+
+}  // namespace raw_image
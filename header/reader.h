@@ -1,19 +1,56 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
 #include <string>
 #include "image.h"
 
+class ThreadPool;
+
 namespace reader {
 
 class IReader {
 public:
     virtual ~IReader() = default;
-    virtual Image GetImage() const = 0;
+    // Hands the decoded image over to the caller; can only be called once.
+    virtual Image GetImage() = 0;
 };
 
-std::shared_ptr<IReader> GetFileReader();
-std::shared_ptr<IReader> GetConsoleReader();
-std::shared_ptr<IReader> GetBMPReader(const std::string& path);
+// Decodes an image a band of rows at a time, for pipelines that never hold the whole image.
+class IRowReader {
+public:
+    virtual ~IRowReader() = default;
+    virtual size_t GetWidth() const = 0;
+    virtual size_t GetHeight() const = 0;
+    // Decodes rows [y, y + count), counted from the top, into planar dst starting at row dst_y.
+    virtual void ReadRows(size_t y, size_t count, Image& dst, size_t dst_y) = 0;
+};
+
+// Stands for standard input where a path is expected.
+constexpr char KConsolePath[] = "-";
+
+// Picks the codec by extension: raw images for "*.raw", BMP otherwise; KConsolePath reads a BMP
+// from standard input. Only the top-left max_width x max_height pixels are decoded. format is
+// the one the filter chain wants; readers of formats that store more precision may return it
+// as stored. Given a pool, BMP rows are decoded on it in bands.
+std::shared_ptr<IReader> GetFileReader(const std::string& path, PixelFormat format = PixelFormat::Float32,
+                                       size_t max_width = SIZE_MAX, size_t max_height = SIZE_MAX,
+                                       ThreadPool* pool = nullptr);
+std::shared_ptr<IRowReader> GetFileRowReader(const std::string& path);
+// Reads a BMP from standard input to its end.
+std::shared_ptr<IReader> GetConsoleReader(PixelFormat format = PixelFormat::Float32, size_t max_width = SIZE_MAX,
+                                          size_t max_height = SIZE_MAX, ThreadPool* pool = nullptr);
+std::shared_ptr<IReader> GetBMPReader(const std::string& path, PixelFormat format = PixelFormat::Float32,
+                                      size_t max_width = SIZE_MAX, size_t max_height = SIZE_MAX,
+                                      ThreadPool* pool = nullptr);
+std::shared_ptr<IRowReader> GetBMPRowReader(const std::string& path);
+// Decodes size bytes of a BMP file held in memory; the bytes are only read during the call.
+std::shared_ptr<IReader> GetBMPMemoryReader(const uint8_t* data, size_t size,
+                                            PixelFormat format = PixelFormat::Float32, size_t max_width = SIZE_MAX,
+                                            size_t max_height = SIZE_MAX, ThreadPool* pool = nullptr);
+// Maps the pixels of the file instead of decoding them.
+std::shared_ptr<IReader> GetRawReader(const std::string& path, PixelFormat format = PixelFormat::Float32,
+                                      size_t max_width = SIZE_MAX, size_t max_height = SIZE_MAX);
+std::shared_ptr<IRowReader> GetRawRowReader(const std::string& path);
 
 }  // namespace reader
\ No newline at end of file
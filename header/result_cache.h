@@ -0,0 +1,71 @@
+#pragma once
+#include "image.h"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+// On-disk cache of filter chain results, addressed by a hash of the input file and the
+// canonical spelling of the chain. For a chain it keeps the encoded output ("<key>.bmp") and
+// the exact final image as a raw intermediate ("<key>.raw"), from which longer chains with the
+// same prefix resume. Files are evicted least recently used first once the directory outgrows
+// its cap; a use refreshes the file's modification time. Hit and miss counts accumulate in a
+// "counters" file, so they cover every run that used the directory.
+class ResultCache {
+public:
+    struct Stats {
+        size_t hits = 0;
+        // Misses that resumed from a cached prefix of the chain.
+        size_t prefix_hits = 0;
+        size_t misses = 0;
+        size_t evictions = 0;
+    };
+
+    // Covers both files of every entry. The raw intermediate keeps 32-bit float planes, so it is
+    // about four times the size of the 24-bit BMP next to it, and an entry about five times.
+    static constexpr uint64_t KDefaultMaxBytes = uint64_t{1} << 30;
+
+    ResultCache(std::string directory, uint64_t max_bytes);
+    // Adds this run's counts to the counters file.
+    ~ResultCache();
+
+    ResultCache(const ResultCache&) = delete;
+    ResultCache& operator=(const ResultCache&) = delete;
+
+    // 64-bit hash of a file's contents.
+    static uint64_t HashFile(const std::string& path);
+
+    // Key of the first count stages of the chain applied to the input with the given hash.
+    static std::string MakeKey(uint64_t input_hash, const std::vector<std::string>& stages, size_t count);
+
+    // Copies the cached result for key to output, encoded like output's extension. False on a miss.
+    bool FetchResult(const std::string& key, const std::string& output);
+    // Path of the cached raw intermediate for key, if there is one.
+    std::optional<std::string> FindIntermediate(const std::string& key);
+
+    // Both replace any entry of the same key and then evict down to the cap.
+    void StoreResult(const std::string& key, const std::string& output);
+    void StoreIntermediate(const std::string& key, const Image& image);
+
+    void CountHit();
+    void CountPrefixHit();
+    void CountMiss();
+
+    const Stats& GetStats() const {
+        return stats_;
+    }
+    // Totals of all runs so far, this one included.
+    Stats GetTotals() const;
+
+private:
+    std::string GetPath(const std::string& key, const std::string& extension) const;
+    std::string MakeTemporaryPath() const;
+    // Copies source to a temporary name in the cache and renames it over the entry.
+    void Insert(const std::string& source, const std::string& entry);
+    void Evict();
+
+    std::string directory_;
+    uint64_t max_bytes_;
+    Stats stats_;
+};
@@ -0,0 +1,111 @@
+#pragma once
+#include "filter.h"
+#include "thread_pool.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+enum class ServeRequestType : uint8_t { Run = 1, Stats = 2, Shutdown = 3 };
+
+// One message from a client. For Run, args are "<input> <output> [-filter [params]]..." as on
+// the command line; when input_bytes is not empty it is the input BMP file itself and args[0] is
+// not opened.
+struct ServeRequest {
+    ServeRequestType type = ServeRequestType::Run;
+    std::vector<std::string> args;
+    std::string input_bytes;
+};
+
+struct ServeResponse {
+    bool ok = false;
+    // The error, the server statistics, or what was written.
+    std::string message;
+};
+
+// "p50 1.20 ms, p90 ..." of latencies in microseconds, by nearest rank.
+std::string DescribeLatencies(std::vector<double> latencies_us);
+
+// Runs filter chains for clients of a Unix domain socket, so the thread pool, the buffer pool and
+// the built filters of recent chains stay warm between requests. A connection may carry any
+// number of requests. Whenever one of them arrives the connection waits in a queue for one of
+// the connection workers, which answers that request and hands the connection back to the
+// accept loop; idle clients hold no worker. New connections arriving at a full queue are turned
+// away with an error. The input files carried by requests being served share a budget of half
+// the memory that was free when the server started; a request beyond it is refused.
+class Server {
+public:
+    Server(std::string socket_path, ThreadPool& pool, size_t concurrency, size_t queue_capacity);
+    ~Server();
+
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    // Serves until a Shutdown request or SIGINT/SIGTERM, then finishes the queued connections.
+    void Run();
+
+    // Request counts and latency percentiles so far.
+    std::string GetStats() const;
+
+private:
+    void ServeConnections();
+    // False once the connection is done with: closed by the client, or left unusable.
+    bool ServeNextRequest(int fd, double queued_us);
+    bool ReserveInput(uint64_t bytes);
+    ServeResponse Handle(const ServeRequest& request);
+    std::vector<FilterPtr> GetFilters(const std::vector<std::string>& args);
+    void RecordLatency(double latency_us, bool ok);
+
+    std::string socket_path_;
+    ThreadPool& pool_;
+    size_t concurrency_;
+    size_t queue_capacity_;
+    int listen_fd_ = -1;
+    // Written to when the server has to stop, to wake up the accept loop.
+    int wake_fds_[2] = {-1, -1};
+    // Written to when a worker hands a connection back to the accept loop.
+    int return_fds_[2] = {-1, -1};
+    std::atomic<bool> stopping_{false};
+
+    // Connections with a request waiting and the time they were queued.
+    std::deque<std::pair<int, double>> queue_;
+    bool queue_closed_ = false;
+    // Connections handed back by the workers, for the accept loop to watch.
+    std::vector<int> returned_;
+    std::mutex queue_mutex_;
+    std::condition_variable queue_cv_;
+
+    uint64_t input_budget_;
+    std::atomic<uint64_t> input_reserved_{0};
+
+    // Built chains by their canonical spelling, so that kernels are computed once.
+    std::map<std::string, std::vector<FilterPtr>> chains_;
+    std::mutex chains_mutex_;
+
+    mutable std::mutex stats_mutex_;
+    std::vector<double> latencies_us_;
+    size_t next_latency_ = 0;
+    size_t requests_ = 0;
+    size_t failed_ = 0;
+    size_t rejected_ = 0;
+};
+
+// A connection to a server.
+class ServeClient {
+public:
+    explicit ServeClient(const std::string& socket_path);
+    ~ServeClient();
+
+    ServeClient(const ServeClient&) = delete;
+    ServeClient& operator=(const ServeClient&) = delete;
+
+    ServeResponse Send(const ServeRequest& request);
+
+private:
+    int fd_;
+};
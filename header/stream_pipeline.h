@@ -0,0 +1,32 @@
+#pragma once
+#include "filter.h"
+#include "reader.h"
+#include "thread_pool.h"
+#include "writer.h"
+#include <memory>
+#include <vector>
+
+class RowStage;
+
+// Runs a filter chain without ever holding the whole image: bands of rows are pulled from the
+// reader through one stage per filter and handed to the writer top to bottom. A filter stage
+// keeps its band plus GetRadius() rows above and below it, a crop stage only forwards the rows
+// and columns inside its window, and a resample stage keeps the input rows its band reads, so
+// memory is O(width * (band + radii)).
+class StreamPipeline {
+public:
+    // Throws if a filter is neither a row filter, a crop nor a resample.
+    StreamPipeline(std::shared_ptr<reader::IRowReader> source, const std::vector<FilterPtr>& filters,
+                   ThreadPool& pool);
+    ~StreamPipeline();
+
+    // Size of the image the chain produces.
+    size_t GetWidth() const;
+    size_t GetHeight() const;
+
+    void Run(writer::IRowWriter& sink);
+
+private:
+    std::unique_ptr<RowStage> last_stage_;
+    size_t band_rows_;
+};
@@ -1,8 +1,12 @@
 #pragma once
 #include "image.h"
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <string>
 
+class ThreadPool;
+
 namespace writer {
 
 class IWriter {
@@ -11,5 +15,30 @@ public:
     virtual void Write(const Image& image) const = 0;
 };
 
-std::shared_ptr<IWriter> GetBMPWriter(const std::string& path);
+// Encodes an image a band of rows at a time, for pipelines that never hold the whole image.
+class IRowWriter {
+public:
+    virtual ~IRowWriter() = default;
+    // Encodes rows [src_y, src_y + count) of src as image rows [y, y + count), counted from the top.
+    virtual void WriteRows(size_t y, const Image& src, size_t src_y, size_t count) = 0;
+};
+
+// Stands for standard output where a path is expected.
+constexpr char KConsolePath[] = "-";
+
+// Picks the codec by extension: raw images for "*.raw", BMP otherwise; KConsolePath writes a
+// BMP to standard output. Given a pool, BMP files are encoded and written on it in blocks.
+std::shared_ptr<IWriter> GetFileWriter(const std::string& path, bool direct_io = false, ThreadPool* pool = nullptr);
+std::shared_ptr<IRowWriter> GetFileRowWriter(const std::string& path, size_t width, size_t height);
+// With direct_io the file is written with O_DIRECT where the file system supports it.
+std::shared_ptr<IWriter> GetBMPWriter(const std::string& path, bool direct_io = false, ThreadPool* pool = nullptr);
+std::shared_ptr<IRowWriter> GetBMPRowWriter(const std::string& path, size_t width, size_t height);
+// Encodes a BMP into buffer, throwing std::length_error if it holds fewer than GetBMPFileSize bytes.
+std::shared_ptr<IWriter> GetBMPMemoryWriter(uint8_t* buffer, size_t capacity, ThreadPool* pool = nullptr);
+std::shared_ptr<IWriter> GetConsoleWriter();
+// Size of the 24-bit BMP file the writers produce for an image of the given size.
+size_t GetBMPFileSize(size_t width, size_t height);
+// Stores the image in its pixel format; rows written in bands are stored as Float32.
+std::shared_ptr<IWriter> GetRawWriter(const std::string& path);
+std::shared_ptr<IRowWriter> GetRawRowWriter(const std::string& path, size_t width, size_t height);
 }  // namespace writer
\ No newline at end of file
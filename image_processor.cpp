@@ -1,95 +1,509 @@
 #include "image.h"
+#include "arg_parser.h"
 #include "reader.h"
 #include "writer.h"
 #include "filter.h"
+#include "filter_registry.h"
+#include "executor.h"
+#include "stream_pipeline.h"
+#include "batch_processor.h"
+#include "buffer_pool.h"
+#include "posix_file.h"
+#include "profiler.h"
+#include "raw_image.h"
+#include "result_cache.h"
+#include "server.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <optional>
+#include <string>
+#include <thread>
 #include <vector>
 #include <stdexcept>
 
 namespace constants {
 constexpr int MinRequiredArgs = 3;
-constexpr int InputFileArgPos = 1;
-constexpr int OutputFileArgPos = 2;
-constexpr int FirstFilterArgPos = 3;
 }  // namespace constants
 
+namespace {
+constexpr double KBytesPerMegabyte = 1024.0 * 1024.0;
+constexpr double KPercent = 100.0;
+constexpr int KUsageColumn = 14;
+constexpr size_t KDefaultServeQueue = 64;
+
+struct Options {
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    bool stream = false;
+    bool batch = false;
+    std::string glob = "*.bmp";
+    bool profile = false;
+    bool direct_io = false;
+    bool plan = false;
+    std::string trace;
+    std::string cache;
+    uint64_t cache_bytes = ResultCache::KDefaultMaxBytes;
+    std::string serve;
+    // Connections served at once; zero means one per thread.
+    size_t concurrency = 0;
+    size_t queue = KDefaultServeQueue;
+    std::string client;
+    size_t repeat = 1;
+    bool inline_input = false;
+    bool stats = false;
+    bool shutdown = false;
+};
+
+// A positive whole number, digits only.
+size_t ParseCount(const std::string& option, const std::string& text) {
+    const std::string error = "Invalid value for " + option + ": " + text;
+    if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos) {
+        throw std::runtime_error(error);
+    }
+    errno = 0;
+    const unsigned long long value = std::strtoull(text.c_str(), nullptr, 10);
+    if (errno != 0 || value > SIZE_MAX) {
+        throw std::runtime_error(error);
+    }
+    if (value == 0) {
+        throw std::runtime_error(option + " must be positive");
+    }
+    return static_cast<size_t>(value);
+}
+
+// Removes "--name value" options from argv, leaving the positional arguments and filters in place.
+Options ExtractOptions(int& argc, char** argv) {
+    Options options;
+    int kept = 1;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg.rfind("--", 0) != 0) {
+            argv[kept++] = argv[i];
+            continue;
+        }
+        if (arg == "--stream") {
+            options.stream = true;
+            continue;
+        }
+        if (arg == "--batch") {
+            options.batch = true;
+            continue;
+        }
+        if (arg == "--profile") {
+            options.profile = true;
+            continue;
+        }
+        if (arg == "--direct-io") {
+            options.direct_io = true;
+            continue;
+        }
+        if (arg == "--plan") {
+            options.plan = true;
+            continue;
+        }
+        if (arg == "--inline") {
+            options.inline_input = true;
+            continue;
+        }
+        if (arg == "--stats") {
+            options.stats = true;
+            continue;
+        }
+        if (arg == "--shutdown") {
+            options.shutdown = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            throw std::runtime_error("Missing value for option " + arg);
+        }
+        if (arg == "--threads") {
+            options.threads = ParseCount(arg, argv[++i]);
+        } else if (arg == "--glob") {
+            options.glob = argv[++i];
+        } else if (arg == "--trace") {
+            options.trace = argv[++i];
+        } else if (arg == "--cache") {
+            options.cache = argv[++i];
+        } else if (arg == "--cache-size") {
+            const size_t megabytes = ParseCount(arg, argv[++i]);
+            options.cache_bytes = static_cast<uint64_t>(static_cast<double>(megabytes) * KBytesPerMegabyte);
+        } else if (arg == "--serve") {
+            options.serve = argv[++i];
+        } else if (arg == "--concurrency") {
+            options.concurrency = ParseCount(arg, argv[++i]);
+        } else if (arg == "--queue") {
+            options.queue = ParseCount(arg, argv[++i]);
+        } else if (arg == "--client") {
+            options.client = argv[++i];
+        } else if (arg == "--repeat") {
+            options.repeat = ParseCount(arg, argv[++i]);
+        } else {
+            throw std::runtime_error("Unknown option: " + arg);
+        }
+    }
+    argc = kept;
+    return options;
+}
+
+void PrintPoolStats(std::ostream& out) {
+    const BufferPool::Stats stats = BufferPool::GetInstance().GetStats();
+    out << "Buffer pool: " << stats.hits << " of " << stats.requests << " requests reused a buffer ("
+        << (stats.requests > 0 ? KPercent * static_cast<double>(stats.hits) / static_cast<double>(stats.requests) : 0.0)
+        << "%), " << static_cast<double>(stats.allocated_bytes) / KBytesPerMegabyte << " MB allocated\n";
+}
+
+// Runs the chain over a manifest or a directory and prints the summary; returns the exit code.
+int RunBatch(const Options& options, const std::string& source, const std::string& output_dir,
+             const std::vector<FilterPtr>& filters) {
+    const std::vector<BatchJob> jobs = std::filesystem::is_directory(source)
+                                           ? ListBatchDirectory(source, options.glob, output_dir)
+                                           : ReadBatchManifest(source, output_dir);
+    std::filesystem::create_directories(output_dir);
+
+    ThreadPool pool(options.threads);
+    const BatchSummary summary = BatchProcessor(pool, options.direct_io).Run(jobs, filters);
+
+    for (const auto& [input, error] : summary.failures) {
+        std::cerr << "Failed: " << input << ": " << error << "\n";
+    }
+    const double seconds = std::max(summary.seconds, 1e-9);
+    std::cout << "Processed " << summary.succeeded << " of " << jobs.size() << " files in " << summary.seconds
+              << " s (" << static_cast<double>(summary.succeeded) / seconds << " files/s, "
+              << static_cast<double>(summary.pixels) / seconds / 1e6 << " MP/s), " << summary.failures.size()
+              << " failed\n";
+    PrintPoolStats(std::cout);
+    return summary.failures.empty() ? 0 : 1;
+}
+
+// Lists the registered filters as "-flag PARAMS  Description".
+void PrintFilters(std::ostream& out) {
+    for (const FilterSpec& spec : FilterRegistry::GetInstance().GetSpecs()) {
+        std::string usage = spec.flag;
+        for (const ParamSpec& param : spec.params) {
+            usage += " " + param.name;
+        }
+        out << "  " << std::left << std::setw(KUsageColumn) << usage << spec.description << "\n";
+    }
+}
+
+// Prints the parsed stages and what the executor derives from them.
+void PrintPlan(std::ostream& out, const ArgParser& args) {
+    for (const FilterStage& stage : args.GetPipeline()) {
+        out << stage.filter->GetName() << ": " << GetFilterKindName(stage.kind);
+        if (stage.kind == FilterKind::Neighbourhood) {
+            out << ", radius " << stage.radius;
+        }
+        out << ", formats";
+        for (PixelFormat format : stage.formats) {
+            out << " " << GetPixelFormatName(format);
+        }
+        out << (stage.keeps_byte_grid ? ", keeps the 8-bit grid" : "") << "\n";
+    }
+
+    const std::vector<FilterPtr> fused = FusePointFilters(args.GetFilters());
+    out << "Passes:";
+    for (const FilterPtr& filter : fused) {
+        out << " " << filter->GetName();
+    }
+    const bool byte_output = !raw_image::IsRawPath(args.GetOutputPath());
+    out << "\nInput format: " << GetPixelFormatName(Executor::GetInputFormat(args.GetFilters(), byte_output)) << "\n";
+    if (const std::optional<CropWindow> window = Executor::GetInputWindow(args.GetFilters())) {
+        out << "Input window: " << window->width << "x" << window->height << "\n";
+    }
+}
+
+// Decodes the part of the input the chain reads, in the narrowest format that gives the same output.
+Image ReadImage(const std::string& path, const std::vector<FilterPtr>& filters, bool byte_output, ThreadPool& pool) {
+    // Named like the stages of batch runs, whatever the file format.
+    ProfileScope scope("Read");
+    const std::optional<CropWindow> window = Executor::GetInputWindow(filters);
+    Image image = reader::GetFileReader(path, Executor::GetInputFormat(filters, byte_output),
+                                        window ? window->width : SIZE_MAX, window ? window->height : SIZE_MAX, &pool)
+                      ->GetImage();
+    scope.SetPixels(image.GetWidth() * image.GetHeight());
+    return image;
+}
+
+void WriteImage(const Options& options, const std::string& path, const Image& image, ThreadPool& pool) {
+    ProfileScope scope("Write", image.GetWidth() * image.GetHeight());
+    writer::GetFileWriter(path, options.direct_io, &pool)->Write(image);
+}
+
+// The input is still being read while the output is written, so a run whose output is its input
+// writes to a temporary file that then replaces it.
+void RunStream(const ArgParser& args, ThreadPool& pool) {
+    ProfileScope scope("Stream");
+    const std::string& output = args.GetOutputPath();
+    const std::string target = IsSameFile(args.GetInputPath(), output) ? MakeTemporaryPath(output) : output;
+    try {
+        StreamPipeline pipeline(reader::GetFileRowReader(args.GetInputPath()), args.GetFilters(), pool);
+        auto writer = writer::GetFileRowWriter(target, pipeline.GetWidth(), pipeline.GetHeight());
+        pipeline.Run(*writer);
+        writer.reset();
+        scope.SetPixels(pipeline.GetWidth() * pipeline.GetHeight());
+        if (target != output) {
+            std::filesystem::rename(target, output);
+        }
+    } catch (...) {
+        if (target != output) {
+            std::error_code error;
+            std::filesystem::remove(target, error);
+        }
+        throw;
+    }
+}
+
+void PrintCacheTotals(std::ostream& out, const ResultCache& cache) {
+    const ResultCache::Stats totals = cache.GetTotals();
+    out << "Cache totals: " << totals.hits << " hits, " << totals.prefix_hits << " resumed, " << totals.misses
+        << " misses, " << totals.evictions << " evicted\n";
+}
+
+// A cached result of the whole chain is copied to the output. Otherwise the chain resumes from
+// the longest prefix whose exact intermediate is cached, and the result and its intermediate
+// are stored. Prefixes never end inside a run of point filters, since the full chain would fuse
+// the run into one pass whose rounding can differ.
+void RunCached(const Options& options, const ArgParser& args, ThreadPool& pool) {
+    ResultCache cache(options.cache, options.cache_bytes);
+    const std::vector<FilterPtr>& filters = args.GetFilters();
+    const std::vector<std::string>& stages = args.GetCanonicalStages();
+
+    uint64_t input_hash = 0;
+    std::string key;
+    bool hit = false;
+    {
+        ProfileScope scope("CacheLookup");
+        input_hash = ResultCache::HashFile(args.GetInputPath());
+        key = ResultCache::MakeKey(input_hash, stages, stages.size());
+        hit = cache.FetchResult(key, args.GetOutputPath());
+    }
+    if (hit) {
+        cache.CountHit();
+        std::cout << "Cache: hit\n";
+        if (options.profile) {
+            PrintCacheTotals(std::cerr, cache);
+        }
+        return;
+    }
+
+    std::optional<Image> image;
+    size_t done = 0;
+    for (size_t count = filters.size(); count > 0 && !image; --count) {
+        if (count < filters.size() && filters[count - 1]->GetPointOp() != nullptr &&
+            filters[count]->GetPointOp() != nullptr) {
+            continue;
+        }
+        const std::optional<std::string> path = cache.FindIntermediate(ResultCache::MakeKey(input_hash, stages, count));
+        if (!path) {
+            continue;
+        }
+        const std::vector<FilterPtr> rest(filters.begin() + static_cast<ptrdiff_t>(count), filters.end());
+        try {
+            image = ReadImage(*path, rest, false, pool);
+            done = count;
+        } catch (const std::exception&) {
+            // Evicted or damaged in the meantime; try a shorter prefix.
+        }
+    }
+
+    const std::vector<FilterPtr> rest(filters.begin() + static_cast<ptrdiff_t>(done), filters.end());
+    if (image) {
+        cache.CountPrefixHit();
+        std::cout << "Cache: resumed after " << done << " of " << filters.size() << " filters\n";
+    } else {
+        cache.CountMiss();
+        std::cout << "Cache: miss\n";
+        // The stored intermediate has to be exact, whatever the output rounds to.
+        image = ReadImage(args.GetInputPath(), rest, false, pool);
+    }
+
+    Executor(pool).Run(*image, rest);
+    WriteImage(options, args.GetOutputPath(), *image, pool);
+
+    ProfileScope scope("CacheStore");
+    if (!filters.empty() && done < filters.size()) {
+        cache.StoreIntermediate(key, *image);
+    }
+    cache.StoreResult(key, args.GetOutputPath());
+    if (options.profile) {
+        PrintCacheTotals(std::cerr, cache);
+    }
+}
+
+int RunServer(const Options& options) {
+    ThreadPool pool(options.threads);
+    Server server(options.serve, pool, options.concurrency > 0 ? options.concurrency : options.threads,
+                  options.queue);
+    std::cout << "Serving on " << options.serve << std::endl;
+    server.Run();
+    std::cout << server.GetStats() << "\n";
+    return 0;
+}
+
+// Sends the command line to a server, repeat times over one connection; returns the exit code.
+int RunClient(const Options& options, int argc, char** argv) {
+    ServeClient client(options.client);
+    if (options.stats || options.shutdown) {
+        ServeRequest request;
+        request.type = options.stats ? ServeRequestType::Stats : ServeRequestType::Shutdown;
+        const ServeResponse response = client.Send(request);
+        (response.ok ? std::cout : std::cerr) << response.message << "\n";
+        return response.ok ? 0 : 1;
+    }
+    if (argc < constants::MinRequiredArgs) {
+        throw std::runtime_error("Input and output paths are required");
+    }
+
+    // The server resolves paths against its own working directory.
+    ServeRequest request;
+    request.args.assign(argv + 1, argv + argc);
+    if (request.args[1] == writer::KConsolePath) {
+        throw std::runtime_error("A server cannot write to the client's standard output");
+    }
+    request.args[1] = std::filesystem::absolute(request.args[1]).string();
+    if (request.args[0] == reader::KConsolePath) {
+        request.input_bytes.assign(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+    } else if (options.inline_input) {
+        request.args[0] = std::filesystem::absolute(request.args[0]).string();
+        std::ifstream file(request.args[0], std::ios::binary);
+        if (!file.is_open()) {
+            throw std::runtime_error("Failed to open file: " + request.args[0]);
+        }
+        request.input_bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    } else {
+        request.args[0] = std::filesystem::absolute(request.args[0]).string();
+    }
+
+    std::vector<double> latencies_us;
+    for (size_t i = 0; i < options.repeat; ++i) {
+        const auto start = std::chrono::steady_clock::now();
+        const ServeResponse response = client.Send(request);
+        latencies_us.push_back(
+            std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+        if (!response.ok) {
+            std::cerr << "Error: " << response.message << "\n";
+            return 1;
+        }
+    }
+    std::cout << "Success! Output saved to: " << request.args[1] << "\n";
+    if (options.repeat > 1) {
+        std::cout << "Latency over " << options.repeat << " requests: " << DescribeLatencies(latencies_us) << "\n";
+    }
+    return 0;
+}
+
+void ReportProfile(const Options& options, const Profiler& profiler) {
+    if (options.profile) {
+        profiler.PrintTable(std::cerr);
+        PrintPoolStats(std::cerr);
+    }
+    if (!options.trace.empty()) {
+        std::ofstream file(options.trace);
+        if (!file.is_open()) {
+            throw std::runtime_error("Failed to create trace file: " + options.trace);
+        }
+        profiler.WriteChromeTrace(file);
+    }
+}
+}  // namespace
+
 int main(int argc, char** argv) {
     try {
-        using constants::FirstFilterArgPos;
-        using constants::InputFileArgPos;
         using constants::MinRequiredArgs;
-        using constants::OutputFileArgPos;
+
+        const Options options = ExtractOptions(argc, argv);
+        if (!options.serve.empty()) {
+            return RunServer(options);
+        }
+        if (!options.client.empty()) {
+            return RunClient(options, argc, argv);
+        }
 
         if (argc < MinRequiredArgs) {
             std::cout << "Usage: " << argv[0]
-                      << " <input.bmp> <output.bmp> [-фильтр1 [параметры]] [-фильтр2 [параметры]]...\n"
-                      << "Available filters:\n"
-                      << "  -neg          Negative\n"
-                      << "  -gs           Grayscale\n"
-                      << "  -crop W H     Crop\n"
-                      << "  -sharp        Sharpening\n"
-                      << "  -edge T       Edge detection\n"
-                      << "  -blur S       Gaussian blur\n"
-                      << "  -sepia        Sepia\n";
+                      << " [--threads N] [--stream] [--direct-io] [--cache DIR [--cache-size MB]] [--plan] [--profile]\n"
+                      << "       [--trace FILE] <input.bmp> <output.bmp> [-фильтр1 [параметры]] [-фильтр2 [параметры]]...\n"
+                      << "       " << argv[0]
+                      << " --batch [--threads N] [--glob PATTERN] [--direct-io] <manifest|directory> <output_dir>"
+                         " [-фильтр1 ...]...\n"
+                      << "       " << argv[0] << " --serve SOCKET [--threads N] [--concurrency N] [--queue N]\n"
+                      << "       " << argv[0]
+                      << " --client SOCKET [--inline] [--repeat N] <input.bmp> <output.bmp> [-фильтр1 ...]...\n"
+                      << "       " << argv[0] << " --client SOCKET --stats|--shutdown\n"
+                      << "Available filters:\n";
+            PrintFilters(std::cout);
+            std::cout << "Options:\n"
+                      << "  --threads N   Worker threads (default: all cores)\n"
+                      << "  --stream      Process the image in bands of rows without loading it whole\n"
+                      << "  --batch       Process every file of a manifest (input[<TAB>output] per line) or directory\n"
+                      << "  --glob P      File name pattern for a batch directory (default: *.bmp)\n"
+                      << "  --direct-io   Write the output with O_DIRECT, bypassing the page cache\n"
+                      << "  --cache DIR   Reuse results of earlier runs stored in DIR, and store this one\n"
+                      << "  --cache-size MB  Evict least recently used cache files beyond this size (default: 1024);\n"
+                      << "                each result also keeps a float copy about 4x its BMP size\n"
+                      << "  --plan        Print how the filter chain would be run and exit\n"
+                      << "  --profile     Print wall time, CPU time, pixels and allocations per stage\n"
+                      << "  --trace FILE  Write the stages as a Chrome trace-event JSON file\n"
+                      << "  --serve S     Keep running and process requests from clients of the Unix socket S\n"
+                      << "  --concurrency N  Requests a server runs at once (default: one per thread)\n"
+                      << "  --queue N     Connections a server keeps waiting before turning new ones away (default: 64)\n"
+                      << "  --client S    Send the request to the server on socket S instead of running it\n"
+                      << "  --inline      Send the input file's bytes rather than its path\n"
+                      << "  --repeat N    Send the request N times and print latency percentiles\n"
+                      << "  --stats       Print a server's request counts and latency percentiles\n"
+                      << "  --shutdown    Stop a server once its queued requests are done\n"
+                      << "Files named *.raw are read and written as raw planar images that keep full precision,\n"
+                      << "for intermediates of chained runs. A path of - reads a BMP from standard input or writes\n"
+                      << "one to standard output.\n";
             return 1;
         }
 
-        auto reader = reader::GetBMPReader(argv[InputFileArgPos]);
-        Image image = reader->GetImage();
-
-        std::vector<FilterPtr> filters;
-        int current_arg = FirstFilterArgPos;
-
-        while (current_arg < argc) {
-            std::string filter_type = argv[current_arg];
-
-            if (filter_type == "-neg") {
-                filters.push_back(CreateNegativeFilter());
-                current_arg += 1;
-            } else if (filter_type == "-gs") {
-                filters.push_back(CreateGrayscaleFilter());
-                current_arg += 1;
-            } else if (filter_type == "-crop") {
-                if (current_arg + 2 >= argc) {
-                    throw std::runtime_error("Not enough arguments for -crop filter");
-                }
-                size_t width = std::stoul(argv[current_arg + 1]);
-                size_t height = std::stoul(argv[current_arg + 2]);
-                filters.push_back(CreateCropFilter(width, height));
-                current_arg += 3;
-            } else if (filter_type == "-sharp") {
-                filters.push_back(CreateSharpeningFilter());
-                current_arg += 1;
-            } else if (filter_type == "-edge") {
-                if (current_arg + 1 >= argc) {
-                    throw std::runtime_error("Not enough arguments for -edge filter");
-                }
-                float threshold = std::stof(argv[current_arg + 1]);
-                filters.push_back(CreateEdgeDetectionFilter(threshold));
-                current_arg += 2;
-            } else if (filter_type == "-blur") {
-                if (current_arg + 1 >= argc) {
-                    throw std::runtime_error("Not enough arguments for -blur filter");
-                }
-                float sigma = std::stof(argv[current_arg + 1]);
-                filters.push_back(CreateGaussianBlurFilter(sigma));
-                current_arg += 2;
-            } else if (filter_type == "-sepia") {
-                filters.push_back(CreateSepiaFilter());
-                current_arg += 1;
-            } else {
-                throw std::runtime_error("Unknown filter type: " + filter_type);
-            }
-        }
-
-        for (auto& filter : filters) {
-            filter->Apply(image);
-        }
-
-        auto writer = writer::GetBMPWriter(argv[OutputFileArgPos]);
-        writer->Write(image);
-
-        std::cout << "Success! Output saved to: " << argv[OutputFileArgPos] << "\n";
+        const ArgParser args(argc, argv);
+        const std::vector<FilterPtr>& filters = args.GetFilters();
+        if (options.plan) {
+            PrintPlan(std::cout, args);
+            return 0;
+        }
+
+        Profiler profiler;
+        if (options.profile || !options.trace.empty()) {
+            Profiler::SetActive(&profiler);
+        }
+
+        if (options.batch) {
+            const int status = RunBatch(options, args.GetInputPath(), args.GetOutputPath(), filters);
+            ReportProfile(options, profiler);
+            return status;
+        }
+
+        const bool console = args.GetInputPath() == reader::KConsolePath || args.GetOutputPath() == writer::KConsolePath;
+        if (console && (options.stream || !options.cache.empty())) {
+            throw std::runtime_error("--stream and --cache need file paths, not standard input or output");
+        }
+
+        ThreadPool pool(options.threads);
+        if (options.stream) {
+            RunStream(args, pool);
+        } else if (!options.cache.empty()) {
+            RunCached(options, args, pool);
+        } else {
+            const bool byte_output = !raw_image::IsRawPath(args.GetOutputPath());
+            Image image = ReadImage(args.GetInputPath(), filters, byte_output, pool);
+            Executor(pool).Run(image, filters);
+            WriteImage(options, args.GetOutputPath(), image, pool);
+        }
+
+        // Standard output may be carrying the image itself.
+        if (args.GetOutputPath() != writer::KConsolePath) {
+            std::cout << "Success! Output saved to: " << args.GetOutputPath() << "\n";
+        }
+        ReportProfile(options, profiler);
 
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << "\n";
@@ -0,0 +1,84 @@
+#include "arg_parser.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+
+namespace {
+constexpr int KInputPathPos = 1;
+constexpr int KOutputPathPos = 2;
+constexpr int KFirstFilterPos = 3;
+// Enough significant digits to tell every float apart.
+constexpr char KRealFormat[] = "%.9g";
+
+// Real values are read with float precision, which is what the filters take.
+double ParseValue(const std::string& text, const ParamSpec& param, const std::string& flag) {
+    const std::string error = "Invalid value '" + text + "' for " + param.name + " of " + flag + " filter";
+    if (text.empty()) {
+        throw std::runtime_error(error);
+    }
+
+    char* end = nullptr;
+    errno = 0;
+    double value = 0.0;
+    if (param.type == ParamType::Integer) {
+        if (text.find_first_not_of("0123456789") != std::string::npos) {
+            throw std::runtime_error(error);
+        }
+        value = static_cast<double>(std::strtoull(text.c_str(), &end, 10));
+    } else {
+        value = std::strtof(text.c_str(), &end);
+    }
+    if (errno != 0 || *end != '\0') {
+        throw std::runtime_error(error);
+    }
+    if (!(value >= param.min && value <= param.max)) {
+        throw std::runtime_error(error + ": out of range");
+    }
+    return value;
+}
+
+std::string FormatValue(double value, ParamType type) {
+    if (type == ParamType::Integer) {
+        return std::to_string(static_cast<unsigned long long>(value));
+    }
+    char text[32];
+    std::snprintf(text, sizeof(text), KRealFormat, value);
+    return text;
+}
+}  // namespace
+
+ArgParser::ArgParser(int argc, char** argv) {
+    if (argc < KFirstFilterPos) {
+        throw std::runtime_error("Input and output paths are required");
+    }
+    input_path_ = argv[KInputPathPos];
+    output_path_ = argv[KOutputPathPos];
+
+    const FilterRegistry& registry = FilterRegistry::GetInstance();
+    std::vector<std::pair<const FilterSpec*, std::vector<double>>> parsed;
+    for (int i = KFirstFilterPos; i < argc;) {
+        const std::string flag = argv[i++];
+        const FilterSpec* spec = registry.Find(flag);
+        if (spec == nullptr) {
+            throw std::runtime_error("Unknown filter type: " + flag);
+        }
+        if (argc - i < static_cast<int>(spec->params.size())) {
+            throw std::runtime_error("Not enough arguments for " + flag + " filter");
+        }
+
+        std::vector<double> values;
+        std::string canonical = flag;
+        for (const ParamSpec& param : spec->params) {
+            values.push_back(ParseValue(argv[i++], param, flag));
+            canonical += " " + FormatValue(values.back(), param.type);
+        }
+        canonical_stages_.push_back(std::move(canonical));
+        parsed.emplace_back(spec, std::move(values));
+    }
+
+    for (const auto& [spec, values] : parsed) {
+        filters_.push_back(spec->factory(values));
+        pipeline_.push_back(DescribeFilter(filters_.back()));
+    }
+}
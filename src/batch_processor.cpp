@@ -0,0 +1,122 @@
+#include "batch_processor.h"
+#include "executor.h"
+#include "profiler.h"
+#include "raw_image.h"
+#include "reader.h"
+#include "writer.h"
+#include <fnmatch.h>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+
+namespace {
+constexpr char KManifestSeparator = '\t';
+constexpr char KManifestComment = '#';
+
+std::string OutputPath(const std::filesystem::path& output_dir, const std::filesystem::path& output) {
+    return output.is_absolute() ? output.string() : (output_dir / output).string();
+}
+}  // namespace
+
+std::vector<BatchJob> ReadBatchManifest(const std::string& manifest, const std::string& output_dir) {
+    std::ifstream file(manifest);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open batch manifest: " + manifest);
+    }
+
+    std::vector<BatchJob> jobs;
+    // Line number of every output so far; two jobs writing one file would race.
+    std::map<std::string, size_t> outputs;
+    std::string line;
+    for (size_t number = 1; std::getline(file, line); ++number) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty() || line.front() == KManifestComment) {
+            continue;
+        }
+
+        const size_t separator = line.find(KManifestSeparator);
+        BatchJob job;
+        job.input = line.substr(0, separator);
+        const std::filesystem::path output = separator == std::string::npos
+                                                 ? std::filesystem::path(job.input).filename()
+                                                 : std::filesystem::path(line.substr(separator + 1));
+        job.output = OutputPath(output_dir, output);
+        const auto [previous, inserted] =
+            outputs.emplace(std::filesystem::path(job.output).lexically_normal().string(), number);
+        if (!inserted) {
+            throw std::runtime_error("Batch manifest lines " + std::to_string(previous->second) + " and " +
+                                     std::to_string(number) + " both write " + job.output);
+        }
+        jobs.push_back(std::move(job));
+    }
+    return jobs;
+}
+
+std::vector<BatchJob> ListBatchDirectory(const std::string& directory, const std::string& glob,
+                                         const std::string& output_dir) {
+    std::vector<BatchJob> jobs;
+    for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+        const std::string name = entry.path().filename().string();
+        if (entry.is_regular_file() && fnmatch(glob.c_str(), name.c_str(), 0) == 0) {
+            jobs.push_back({entry.path().string(), OutputPath(output_dir, name)});
+        }
+    }
+    std::sort(jobs.begin(), jobs.end(), [](const BatchJob& a, const BatchJob& b) { return a.input < b.input; });
+    return jobs;
+}
+
+BatchProcessor::BatchProcessor(ThreadPool& pool, bool direct_io) : pool_(pool), direct_io_(direct_io) {
+}
+
+BatchSummary BatchProcessor::Run(const std::vector<BatchJob>& jobs, const std::vector<FilterPtr>& filters) {
+    const auto start = std::chrono::steady_clock::now();
+    const PixelFormat byte_output_format = Executor::GetInputFormat(filters);
+    const PixelFormat exact_output_format = Executor::GetInputFormat(filters, false);
+    const std::optional<CropWindow> window = Executor::GetInputWindow(filters);
+    const size_t max_width = window ? window->width : SIZE_MAX;
+    const size_t max_height = window ? window->height : SIZE_MAX;
+
+    // With fewer files than threads each file is split into bands as well; otherwise every
+    // file runs on the thread that picked it up.
+    ThreadPool serial(1);
+    ThreadPool& image_pool = jobs.size() < pool_.GetThreadCount() ? pool_ : serial;
+
+    BatchSummary summary;
+    std::mutex mutex;
+    pool_.ParallelFor(jobs.size(), [&](size_t i) {
+        const BatchJob& job = jobs[i];
+        try {
+            std::optional<Image> image;
+            {
+                ProfileScope scope("Read");
+                const PixelFormat format =
+                    raw_image::IsRawPath(job.output) ? exact_output_format : byte_output_format;
+                image = reader::GetFileReader(job.input, format, max_width, max_height, &image_pool)->GetImage();
+                scope.SetPixels(image->GetWidth() * image->GetHeight());
+            }
+            Executor(image_pool).Run(*image, filters);
+            {
+                ProfileScope scope("Write", image->GetWidth() * image->GetHeight());
+                writer::GetFileWriter(job.output, direct_io_, &image_pool)->Write(*image);
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            ++summary.succeeded;
+            summary.pixels += image->GetWidth() * image->GetHeight();
+        } catch (const std::exception& e) {
+            std::lock_guard<std::mutex> lock(mutex);
+            summary.failures.emplace_back(job.input, e.what());
+        }
+    });
+
+    std::sort(summary.failures.begin(), summary.failures.end());
+    summary.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return summary;
+}
@@ -0,0 +1,73 @@
+#include "buffer_pool.h"
+#include "profiler.h"
+#include <cstdlib>
+#include <new>
+
+namespace {
+// Each power of two is split into this many buckets.
+constexpr size_t KBucketsPerOctave = 4;
+}  // namespace
+
+BufferPool& BufferPool::GetInstance() {
+    static BufferPool pool;
+    return pool;
+}
+
+BufferPool::~BufferPool() {
+    for (auto& [size, buffers] : free_) {
+        for (uint8_t* data : buffers) {
+            std::free(data);
+        }
+    }
+}
+
+size_t BufferPool::GetBucketSize(size_t bytes) {
+    size_t octave = KAlignment * KBucketsPerOctave;
+    while (octave * 2 <= bytes) {
+        octave *= 2;
+    }
+    const size_t step = octave / KBucketsPerOctave;
+    return (bytes + step - 1) / step * step;
+}
+
+uint8_t* BufferPool::Acquire(size_t bytes) {
+    const size_t size = GetBucketSize(bytes);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++stats_.requests;
+        auto it = free_.find(size);
+        if (it != free_.end() && !it->second.empty()) {
+            uint8_t* data = it->second.back();
+            it->second.pop_back();
+            ++stats_.hits;
+            stats_.cached_bytes -= size;
+            return data;
+        }
+        stats_.allocated_bytes += size;
+    }
+
+    auto* data = static_cast<uint8_t*>(std::aligned_alloc(KAlignment, size));
+    if (data == nullptr) {
+        throw std::bad_alloc();
+    }
+    Profiler::CountAllocation(size);
+    return data;
+}
+
+void BufferPool::Release(uint8_t* data, size_t bytes) {
+    const size_t size = GetBucketSize(bytes);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stats_.cached_bytes + size <= KMaxCachedBytes) {
+            free_[size].push_back(data);
+            stats_.cached_bytes += size;
+            return;
+        }
+    }
+    std::free(data);
+}
+
+BufferPool::Stats BufferPool::GetStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
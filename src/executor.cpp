@@ -0,0 +1,108 @@
+#include "executor.h"
+#include "profiler.h"
+#include <algorithm>
+#include <utility>
+
+namespace {
+constexpr size_t KMinBandRows = 16;
+constexpr size_t KBandsPerThread = 4;
+// Bands much thinner than the halo would spend most of their time recomputing it.
+constexpr size_t KHaloToBandRatio = 4;
+}  // namespace
+
+Executor::Executor(ThreadPool& pool) : pool_(pool) {
+}
+
+void Executor::Run(Image& image, const std::vector<FilterPtr>& filters) {
+    for (const FilterPtr& filter : FusePointFilters(filters)) {
+        ProfileScope scope([&filter] { return filter->GetName(); }, image.GetWidth() * image.GetHeight());
+        if (!filter->Accepts(image.GetFormat())) {
+            image.SetFormat(PixelFormat::Float32);
+        }
+        // A crop only narrows the view, so a mask stays a single plane through it.
+        if (image.GetLayout() != PixelLayout::Mono || filter->GetCropWindow() == nullptr) {
+            image.SetLayout(PixelLayout::Planar);
+        }
+        const auto* row_filter = dynamic_cast<const RowFilter*>(filter.get());
+        if (const auto* resample = dynamic_cast<const ResampleFilter*>(filter.get())) {
+            RunResample(image, *resample);
+        } else if (row_filter != nullptr && pool_.GetThreadCount() > 1) {
+            RunBands(image, *row_filter);
+        } else {
+            filter->Apply(image);
+        }
+    }
+}
+
+PixelFormat Executor::GetInputFormat(const std::vector<FilterPtr>& filters, bool byte_output) {
+    const std::vector<FilterPtr> fused = FusePointFilters(filters);
+    // Rounding an output to 8 bits is harmless when only crops, which just copy, and the
+    // writer, which rounds the same way, come after it.
+    bool exact_output_needed = !byte_output;
+    for (auto it = fused.rbegin(); it != fused.rend(); ++it) {
+        const IFilter& filter = **it;
+        if (!filter.Accepts(PixelFormat::UInt8) || (exact_output_needed && !filter.KeepsByteGrid())) {
+            return PixelFormat::Float32;
+        }
+        exact_output_needed = exact_output_needed || filter.GetCropWindow() == nullptr;
+    }
+    return PixelFormat::UInt8;
+}
+
+std::optional<CropWindow> Executor::GetInputWindow(const std::vector<FilterPtr>& filters) {
+    std::optional<CropWindow> window;
+    for (const FilterPtr& filter : filters) {
+        if (const CropWindow* crop = filter->GetCropWindow()) {
+            window = window ? CropWindow{std::min(window->width, crop->width), std::min(window->height, crop->height)}
+                            : *crop;
+        } else if (filter->GetPointOp() == nullptr) {
+            break;
+        }
+    }
+    return window;
+}
+
+void Executor::RunBands(Image& image, const RowFilter& filter) {
+    const size_t height = image.GetHeight();
+    const size_t target_bands = pool_.GetThreadCount() * KBandsPerThread;
+    const size_t band_rows =
+        std::max({KMinBandRows, KHaloToBandRatio * filter.GetRadius(), (height + target_bands - 1) / target_bands});
+    const size_t bands = (height + band_rows - 1) / band_rows;
+
+    if (bands <= 1) {
+        filter.Apply(image);
+        return;
+    }
+
+    auto run_bands = [&](const Image& src, Image& dst) {
+        pool_.ParallelFor(bands, [&](size_t band) {
+            const size_t begin = band * band_rows;
+            const size_t end = std::min(begin + band_rows, height);
+            filter.ApplyRows(src, dst, begin, end);
+        });
+    };
+
+    if (filter.GetRadius() == 0) {
+        run_bands(image, image);
+        return;
+    }
+    Image result = filter.CreateOutput(image);
+    run_bands(image, result);
+    image = std::move(result);
+}
+
+void Executor::RunResample(Image& image, const ResampleFilter& filter) {
+    const std::unique_ptr<ResamplePlan> plan = filter.Prepare(image.GetWidth(), image.GetHeight());
+    const size_t height = plan->GetHeight();
+    const size_t target_bands = pool_.GetThreadCount() * KBandsPerThread;
+    const size_t band_rows = std::max(KMinBandRows, (height + target_bands - 1) / target_bands);
+    const size_t bands = (height + band_rows - 1) / band_rows;
+
+    Image result = Image::CreateUninitialized(plan->GetWidth(), height);
+    pool_.ParallelFor(bands, [&](size_t band) {
+        const size_t begin = band * band_rows;
+        const size_t end = std::min(begin + band_rows, height);
+        plan->ApplyRows(image, 0, result, begin, begin, end);
+    });
+    image = std::move(result);
+}
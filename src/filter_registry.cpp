@@ -0,0 +1,108 @@
+#include "filter_registry.h"
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+// The largest integers a double still holds exactly.
+constexpr double KMaxInteger = 9007199254740992.0;
+constexpr double KMaxReal = std::numeric_limits<float>::max();
+// The smallest positive float, for parameters that must be greater than zero.
+constexpr double KMinPositive = std::numeric_limits<float>::min();
+// Larger blurs are flat at any image size the BMP format holds, and cost time and memory
+// growing with sigma.
+constexpr double KMaxSigma = 2000.0;
+
+size_t ToSize(double value) {
+    return static_cast<size_t>(value);
+}
+}  // namespace
+
+FilterStage DescribeFilter(const FilterPtr& filter) {
+    FilterStage stage{filter, FilterKind::Global, 0, {}, filter->KeepsByteGrid()};
+    const auto* row_filter = dynamic_cast<const RowFilter*>(filter.get());
+    if (filter->GetCropWindow() != nullptr) {
+        stage.kind = FilterKind::Crop;
+    } else if (filter->GetPointOp() != nullptr || (row_filter != nullptr && row_filter->GetRadius() == 0)) {
+        stage.kind = FilterKind::Point;
+    } else if (row_filter != nullptr) {
+        stage.kind = FilterKind::Neighbourhood;
+        stage.radius = row_filter->GetRadius();
+    } else if (dynamic_cast<const ResampleFilter*>(filter.get()) != nullptr) {
+        stage.kind = FilterKind::Resample;
+    }
+    for (PixelFormat format : {PixelFormat::Float32, PixelFormat::UInt16, PixelFormat::UInt8}) {
+        if (filter->Accepts(format)) {
+            stage.formats.push_back(format);
+        }
+    }
+    return stage;
+}
+
+const char* GetFilterKindName(FilterKind kind) {
+    switch (kind) {
+        case FilterKind::Point:
+            return "point";
+        case FilterKind::Crop:
+            return "crop";
+        case FilterKind::Neighbourhood:
+            return "neighbourhood";
+        case FilterKind::Resample:
+            return "resample";
+        case FilterKind::Global:
+            break;
+    }
+    return "global";
+}
+
+const char* GetPixelFormatName(PixelFormat format) {
+    switch (format) {
+        case PixelFormat::UInt8:
+            return "UInt8";
+        case PixelFormat::UInt16:
+            return "UInt16";
+        case PixelFormat::Float32:
+            break;
+    }
+    return "Float32";
+}
+
+FilterRegistry& FilterRegistry::GetInstance() {
+    static FilterRegistry registry;
+    return registry;
+}
+
+FilterRegistry::FilterRegistry() {
+    Register({"-neg", "Negative", {}, [](const std::vector<double>&) { return CreateNegativeFilter(); }});
+    Register({"-gs", "Grayscale", {}, [](const std::vector<double>&) { return CreateGrayscaleFilter(); }});
+    Register({"-crop", "Crop",
+              {{"W", ParamType::Integer, 1, KMaxInteger}, {"H", ParamType::Integer, 1, KMaxInteger}},
+              [](const std::vector<double>& args) { return CreateCropFilter(ToSize(args[0]), ToSize(args[1])); }});
+    Register({"-sharp", "Sharpening", {}, [](const std::vector<double>&) { return CreateSharpeningFilter(); }});
+    Register({"-edge", "Edge detection", {{"T", ParamType::Real, -KMaxReal, KMaxReal}},
+              [](const std::vector<double>& args) { return CreateEdgeDetectionFilter(static_cast<float>(args[0])); }});
+    Register({"-blur", "Gaussian blur", {{"S", ParamType::Real, KMinPositive, KMaxSigma}},
+              [](const std::vector<double>& args) { return CreateGaussianBlurFilter(static_cast<float>(args[0])); }});
+    Register({"-sepia", "Sepia", {}, [](const std::vector<double>&) { return CreateSepiaFilter(); }});
+    Register({"-resize", "Resize",
+              {{"W", ParamType::Integer, 1, KMaxInteger}, {"H", ParamType::Integer, 1, KMaxInteger}},
+              [](const std::vector<double>& args) { return CreateResizeFilter(ToSize(args[0]), ToSize(args[1])); }});
+    Register({"-scale", "Scale both sides", {{"F", ParamType::Real, KMinPositive, KMaxReal}},
+              [](const std::vector<double>& args) { return CreateScaleFilter(static_cast<float>(args[0])); }});
+}
+
+void FilterRegistry::Register(FilterSpec spec) {
+    if (Find(spec.flag) != nullptr) {
+        throw std::invalid_argument("Filter " + spec.flag + " is already registered");
+    }
+    specs_.push_back(std::move(spec));
+}
+
+const FilterSpec* FilterRegistry::Find(const std::string& flag) const {
+    for (const FilterSpec& spec : specs_) {
+        if (spec.flag == flag) {
+            return &spec;
+        }
+    }
+    return nullptr;
+}
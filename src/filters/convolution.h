@@ -0,0 +1,105 @@
+#pragma once
+#include "filter.h"
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <utility>
+
+// Square convolution kernels known at compile time. A kernel is a type with
+//     static constexpr size_t KSize;               // odd
+//     static constexpr float KWeights[KSize][KSize];
+// Taps are summed row by row, left to right, starting from 0. Zero weights are skipped and
+// weights of 1 and -1 become an addition or subtraction, which gives the same floats as
+// multiplying. Pixels far enough from the left and right edges read their row directly; the
+// others clamp the column.
+namespace convolution {
+
+template <typename Kernel, size_t Tap, typename Column>
+inline void AddTap(float& sum, const float* const* rows, Column column) {
+    constexpr size_t KRow = Tap / Kernel::KSize;
+    constexpr int KColumn = static_cast<int>(Tap % Kernel::KSize) - static_cast<int>(Kernel::KSize / 2);
+    constexpr float KWeight = Kernel::KWeights[KRow][Tap % Kernel::KSize];
+    if constexpr (KWeight == 1.0f) {
+        sum += rows[KRow][column(KColumn)];
+    } else if constexpr (KWeight == -1.0f) {
+        sum -= rows[KRow][column(KColumn)];
+    } else if constexpr (KWeight != 0.0f) {
+        sum += rows[KRow][column(KColumn)] * KWeight;
+    }
+}
+
+template <typename Kernel, typename Column, size_t... Taps>
+inline float SumTaps(const float* const* rows, Column column, std::index_sequence<Taps...>) {
+    float sum = 0.0f;
+    (AddTap<Kernel, Taps>(sum, rows, column), ...);
+    return sum;
+}
+
+// Writes out[x] = post(sum of the kernel taps around x) for a row of width pixels. rows holds
+// the KSize input rows centred on the output row, already clamped to the image.
+template <typename Kernel, typename Out, typename Post>
+void ConvolveRow(const float* const* rows, size_t width, Out* out, Post post) {
+    constexpr size_t KRadius = Kernel::KSize / 2;
+    using Taps = std::make_index_sequence<Kernel::KSize * Kernel::KSize>;
+    const int last_x = static_cast<int>(width) - 1;
+    const size_t interior_begin = std::min(KRadius, width);
+    const size_t interior_end = width > KRadius ? std::max(width - KRadius, interior_begin) : interior_begin;
+
+    auto border = [&](size_t x) {
+        auto column = [x, last_x](int dx) { return std::clamp(static_cast<int>(x) + dx, 0, last_x); };
+        out[x] = post(SumTaps<Kernel>(rows, column, Taps{}));
+    };
+    for (size_t x = 0; x < interior_begin; ++x) {
+        border(x);
+    }
+    for (size_t x = interior_begin; x < interior_end; ++x) {
+        auto column = [x](int dx) { return static_cast<ptrdiff_t>(x) + dx; };
+        out[x] = post(SumTaps<Kernel>(rows, column, Taps{}));
+    }
+    for (size_t x = interior_end; x < width; ++x) {
+        border(x);
+    }
+}
+
+// Pointers to the KSize rows of a plane centred on row y, clamped to rows [0, height).
+template <typename Kernel, typename RowAt>
+void GatherRows(RowAt row_at, size_t y, size_t height, const float** rows) {
+    const int last_y = static_cast<int>(height) - 1;
+    for (size_t i = 0; i < Kernel::KSize; ++i) {
+        const int row = static_cast<int>(y + i) - static_cast<int>(Kernel::KSize / 2);
+        rows[i] = row_at(static_cast<size_t>(std::clamp(row, 0, last_y)));
+    }
+}
+
+// A filter that convolves every channel with Kernel and saturates the result to [0, 1].
+template <typename Kernel>
+class ConvolutionFilter : public RowFilter {
+public:
+    explicit ConvolutionFilter(std::string name) : name_(std::move(name)) {
+    }
+
+    std::string GetName() const override {
+        return name_;
+    }
+
+    size_t GetRadius() const override {
+        return Kernel::KSize / 2;
+    }
+
+    void ApplyRows(const Image& src, Image& dst, size_t begin, size_t end) const override {
+        const float* rows[Kernel::KSize];
+        for (size_t c = 0; c < Image::KChannels; ++c) {
+            for (size_t y = begin; y < end; ++y) {
+                GatherRows<Kernel>([&src, c](size_t row) { return src.ChannelRow(c, row); }, y, src.GetHeight(),
+                                   rows);
+                ConvolveRow<Kernel>(rows, src.GetWidth(), dst.ChannelRow(c, y),
+                                    [](float sum) { return std::clamp(sum, 0.0f, 1.0f); });
+            }
+        }
+    }
+
+private:
+    std::string name_;
+};
+
+}  // namespace convolution
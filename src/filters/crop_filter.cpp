@@ -1,27 +1,35 @@
 #include "filter.h"
 #include "image.h"
+#include <algorithm>
 
 class CropFilter : public IFilter {
 public:
-    CropFilter(size_t width, size_t height) : width_(width), height_(height) {
+    CropFilter(size_t width, size_t height) : window_{width, height} {
     }
 
+    std::string GetName() const override {
+        return "Crop";
+    }
+
+    const CropWindow* GetCropWindow() const override {
+        return &window_;
+    }
+
+    bool Accepts(PixelFormat) const override {
+        return true;
+    }
+
+    bool KeepsByteGrid() const override {
+        return true;
+    }
+
+    // Narrows the image to a view of its own buffer, without copying pixels.
     void Apply(Image& image) const override {
-        size_t new_width = std::min(width_, image.GetWidth());
-        size_t new_height = std::min(height_, image.GetHeight());
-        Image result(new_width, new_height);
-
-        for (size_t y = 0; y < new_height; ++y) {
-            for (size_t x = 0; x < new_width; ++x) {
-                result.SetPixel(x, y, image.GetPixel(x, y));
-            }
-        }
-        image = result;
+        image.Crop(0, 0, std::min(window_.width, image.GetWidth()), std::min(window_.height, image.GetHeight()));
     }
 
 private:
-    size_t width_;
-    size_t height_;
+    CropWindow window_;
 };
 
 FilterPtr CreateCropFilter(size_t width, size_t height) {
@@ -1,6 +1,9 @@
 #include "filter.h"
+#include "convolution.h"
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <vector>
 
 namespace constants {
 constexpr float KRedLuminance = 0.299f;
@@ -8,50 +11,111 @@ constexpr float KGreenLuminance = 0.587f;
 constexpr float KBlueLuminance = 0.114f;
 }  // namespace constants
 
-class EdgeDetectionFilter : public IFilter {
+namespace {
+struct LaplacianKernel {
+    static constexpr size_t KSize = 3;
+    static constexpr float KWeights[KSize][KSize] = {{0, -1, 0}, {-1, 4, -1}, {0, -1, 0}};
+};
+}  // namespace
+
+// Computes the luminance of each input row once, in a rolling window of three rows, and
+// thresholds the Laplacian straight into the output. The result is black or white, so whatever
+// the input format it is kept as a single 8-bit plane that the writers expand to BGR.
+class EdgeDetectionFilter : public RowFilter {
 public:
     explicit EdgeDetectionFilter(float threshold) : threshold_(threshold) {
     }
 
-    void Apply(Image& image) const override {
-        Image grayscale(image.GetWidth(), image.GetHeight());
+    std::string GetName() const override {
+        return "EdgeDetection";
+    }
 
-        for (size_t y = 0; y < image.GetHeight(); ++y) {
-            for (size_t x = 0; x < image.GetWidth(); ++x) {
-                Pixel p = image.GetPixel(x, y);
-                float gray =
-                    constants::KRedLuminance * p.r + constants::KGreenLuminance * p.g + constants::KBlueLuminance * p.b;
-                grayscale.SetPixel(x, y, {gray, gray, gray});
-            }
-        }
+    bool Accepts(PixelFormat format) const override {
+        return format == PixelFormat::Float32 || format == PixelFormat::UInt8;
+    }
 
-        Image result(image.GetWidth(), image.GetHeight());
-        const float kernel[3][3] = {{0, -1, 0}, {-1, 4, -1}, {0, -1, 0}};
+    bool KeepsByteGrid() const override {
+        return true;
+    }
+
+    size_t GetRadius() const override {
+        return 1;
+    }
 
-        for (size_t y = 0; y < grayscale.GetHeight(); ++y) {
-            for (size_t x = 0; x < grayscale.GetWidth(); ++x) {
-                float sum = 0.0f;
+    Image CreateOutput(const Image& src) const override {
+        return Image::CreateUninitialized(src.GetWidth(), src.GetHeight(), PixelLayout::Mono, PixelFormat::UInt8);
+    }
 
-                for (int dy = -1; dy <= 1; ++dy) {
-                    for (int dx = -1; dx <= 1; ++dx) {
-                        int nx = std::clamp(static_cast<int>(x) + dx, 0, static_cast<int>(grayscale.GetWidth()) - 1);
-                        int ny = std::clamp(static_cast<int>(y) + dy, 0, static_cast<int>(grayscale.GetHeight()) - 1);
+    void ApplyRows(const Image& src, Image& dst, size_t begin, size_t end) const override {
+        const size_t width = src.GetWidth();
+        const int last_y = static_cast<int>(src.GetHeight()) - 1;
+        thread_local std::vector<float> window;
+        window.resize(LaplacianKernel::KSize * width);
 
-                        Pixel p = grayscale.GetPixel(nx, ny);
-                        sum += p.r * kernel[dy + 1][dx + 1];
-                    }
-                }
+        // Window slot of input row y (before clamping); a row keeps its slot while it is in the window.
+        float* const rows_data = window.data();
+        auto slot = [rows_data, width](int y) {
+            return rows_data + static_cast<size_t>(y + 1) % LaplacianKernel::KSize * width;
+        };
+        auto load = [&](int y) { Luminance(src, static_cast<size_t>(std::clamp(y, 0, last_y)), slot(y)); };
 
-                float value = std::clamp(sum, 0.0f, 1.0f);
-                value = (value > threshold_) ? 1.0f : 0.0f;
-                result.SetPixel(x, y, {value, value, value});
+        load(static_cast<int>(begin) - 1);
+        load(static_cast<int>(begin));
+        const float* rows[LaplacianKernel::KSize];
+        for (size_t y = begin; y < end; ++y) {
+            const int row = static_cast<int>(y);
+            load(row + 1);
+            for (size_t i = 0; i < LaplacianKernel::KSize; ++i) {
+                rows[i] = slot(row - 1 + static_cast<int>(i));
             }
-        }
 
-        image = result;
+            // The stream pipeline hands in planar Float32 rows instead of a mask.
+            const bool planar = dst.GetLayout() == PixelLayout::Planar;
+            if (dst.GetFormat() == PixelFormat::UInt8) {
+                uint8_t* red = dst.ChannelRow<uint8_t>(0, y);
+                convolution::ConvolveRow<LaplacianKernel>(rows, width, red, [this](float sum) {
+                    return std::clamp(sum, 0.0f, 1.0f) > threshold_ ? KMaskOn : KMaskOff;
+                });
+                if (planar) {
+                    std::copy_n(red, width, dst.ChannelRow<uint8_t>(1, y));
+                    std::copy_n(red, width, dst.ChannelRow<uint8_t>(2, y));
+                }
+            } else {
+                float* red = dst.ChannelRow(0, y);
+                convolution::ConvolveRow<LaplacianKernel>(rows, width, red, [this](float sum) {
+                    return std::clamp(sum, 0.0f, 1.0f) > threshold_ ? 1.0f : 0.0f;
+                });
+                if (planar) {
+                    std::copy_n(red, width, dst.ChannelRow(1, y));
+                    std::copy_n(red, width, dst.ChannelRow(2, y));
+                }
+            }
+        }
     }
 
 private:
+    static constexpr uint8_t KMaskOn = 255;
+    static constexpr uint8_t KMaskOff = 0;
+
+    template <typename T, typename Convert>
+    static void Luminance(const Image& src, size_t y, float* gray, Convert convert) {
+        const T* r = src.ChannelRow<T>(0, y);
+        const T* g = src.ChannelRow<T>(1, y);
+        const T* b = src.ChannelRow<T>(2, y);
+        for (size_t x = 0; x < src.GetWidth(); ++x) {
+            gray[x] = constants::KRedLuminance * convert(r[x]) + constants::KGreenLuminance * convert(g[x]) +
+                      constants::KBlueLuminance * convert(b[x]);
+        }
+    }
+
+    static void Luminance(const Image& src, size_t y, float* gray) {
+        if (src.GetFormat() == PixelFormat::UInt8) {
+            Luminance<uint8_t>(src, y, gray, pixel::FromByte);
+        } else {
+            Luminance<float>(src, y, gray, [](float value) { return value; });
+        }
+    }
+
     float threshold_;
 };
 
@@ -2,21 +2,130 @@
 #include "image.h"
 #include <algorithm>
 #include <vector>
+#include <climits>
 #include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
 
 namespace {
 constexpr float KSigmaMultiplier = 3.0f;
 constexpr float KTwoValue = 2.0f;
+
+// From this sigma on, the blur is a cascade of box filters whose cost does not depend on sigma.
+// Against the exact kernel the written image differs by at most 4 of 256 levels per channel on
+// hard synthetic edges and 2 on photographs (measured for sigma 8-60); below 8 the few-pixel
+// boxes are too coarse. The cascade reaches about 3.5 sigma instead of 3.
+constexpr float KBoxCascadeMinSigma = 8.0f;
+constexpr size_t KBoxPasses = 5;
+// Box sums are exact in 44.20 fixed point, so the result does not depend on where a band starts.
+constexpr float KFixedScale = 1 << 20;
+// The widths of consecutive passes multiply up to at most this before the sums are divided by
+// their product again, which keeps the sums of values in [0, 1] below 2^61.
+constexpr uint64_t KMaxBoxProduct = uint64_t{1} << 41;
+// Columns the vertical passes work on at a time, so the rows they read stay in cache.
+constexpr size_t KStripColumns = 256;
+// Neither blur reaches further than 4 sigma, so the radius and every box width fit in an int.
+constexpr float KMaxSigma = static_cast<float>(INT_MAX / 4);
+
+// Odd box widths whose cascade has the variance of a Gaussian with the given sigma as closely
+// as whole widths allow (W. Kovesi, "Fast almost-Gaussian filtering").
+std::vector<size_t> BoxWidths(float sigma) {
+    const double n = static_cast<double>(KBoxPasses);
+    const double variance = static_cast<double>(sigma) * sigma;
+    auto lower = static_cast<long>(std::floor(std::sqrt(12.0 * variance / n + 1.0)));
+    if (lower % 2 == 0) {
+        --lower;
+    }
+    const double wl = static_cast<double>(lower);
+    const long lower_passes = std::lround((12.0 * variance - n * wl * wl - 4.0 * n * wl - 3.0 * n) / (-4.0 * wl - 4.0));
+
+    std::vector<size_t> widths(KBoxPasses);
+    for (size_t i = 0; i < KBoxPasses; ++i) {
+        widths[i] = static_cast<size_t>(static_cast<long>(i) < lower_passes ? lower : lower + 2);
+    }
+    return widths;
+}
+
+// Divides by divisor, rounding halves away from zero.
+void Renormalise(int64_t* values, size_t count, int64_t divisor) {
+    const int64_t half = divisor / 2;
+    for (size_t i = 0; i < count; ++i) {
+        values[i] = values[i] >= 0 ? (values[i] + half) / divisor : -((half - values[i]) / divisor);
+    }
+}
+
+// Runs the box passes over lines laid out as rows of stride values, length + sum(w - 1) rows in
+// front of the other; the sums after pass i are divided by divisors[i] unless it is 1.
+// Afterwards the first length rows of the returned buffer hold the sums.
+std::vector<int64_t>& RunBoxPasses(const std::vector<size_t>& widths, const std::vector<int64_t>& divisors,
+                                   std::vector<int64_t>& in, std::vector<int64_t>& out, size_t rows, size_t stride) {
+    std::vector<int64_t>* src = &in;
+    std::vector<int64_t>* dst = &out;
+    for (size_t pass = 0; pass < widths.size(); ++pass) {
+        const size_t width = widths[pass];
+        rows -= width - 1;
+        const int64_t* from = src->data();
+        int64_t* to = dst->data();
+        for (size_t x = 0; x < stride; ++x) {
+            int64_t sum = 0;
+            for (size_t j = 0; j < width; ++j) {
+                sum += from[j * stride + x];
+            }
+            to[x] = sum;
+        }
+        for (size_t i = 1; i < rows; ++i) {
+            const int64_t* added = from + (i + width - 1) * stride;
+            const int64_t* removed = from + (i - 1) * stride;
+            const int64_t* previous = to + (i - 1) * stride;
+            int64_t* current = to + i * stride;
+            for (size_t x = 0; x < stride; ++x) {
+                current[x] = previous[x] + added[x] - removed[x];
+            }
+        }
+        if (divisors[pass] != 1) {
+            Renormalise(to, rows * stride, divisors[pass]);
+        }
+        std::swap(src, dst);
+    }
+    return *src;
+}
+
+int64_t ToFixed(float value) {
+    return static_cast<int64_t>(std::lrint(value * KFixedScale));
+}
 }  // namespace
 
-class GaussianBlurFilter : public IFilter {
+class GaussianBlurFilter : public RowFilter {
 public:
     explicit GaussianBlurFilter(float sigma) : sigma_(sigma) {
+        if (!(sigma_ > 0.0f && sigma_ <= KMaxSigma)) {
+            throw std::runtime_error("Blur sigma must be positive and at most " + std::to_string(INT_MAX / 4));
+        }
+        if (sigma_ >= KBoxCascadeMinSigma) {
+            box_widths_ = BoxWidths(sigma_);
+            box_divisors_.assign(box_widths_.size(), 1);
+            radius_ = 0;
+            uint64_t product = 1;
+            for (size_t pass = 0; pass < box_widths_.size(); ++pass) {
+                const size_t width = box_widths_[pass];
+                radius_ += static_cast<int>(width / 2);
+                if (pass > 0 && product > KMaxBoxProduct / width) {
+                    box_divisors_[pass - 1] = static_cast<int64_t>(product);
+                    product = 1;
+                }
+                product *= width;
+            }
+            box_scale_ = 1.0 / (static_cast<double>(KFixedScale) * static_cast<double>(product));
+            return;
+        }
+
         radius_ = static_cast<int>(std::ceil(KSigmaMultiplier * sigma_));
         kernel_.resize(2 * radius_ + 1);
         float sum = 0.0f;
         for (int i = -radius_; i <= radius_; ++i) {
-            const float exponent = -static_cast<float>(i * i) / (KTwoValue * sigma_ * sigma_);
+            // The centre is set directly: for sigmas whose square underflows it would be 0 / 0.
+            const float exponent = i == 0 ? 0.0f : -static_cast<float>(i * i) / (KTwoValue * sigma_ * sigma_);
             kernel_[i + radius_] = std::exp(exponent);
             sum += kernel_[i + radius_];
         }
@@ -25,40 +134,147 @@ public:
         }
     }
 
-    void Apply(Image& image) const override {
-        Image temp(image.GetWidth(), image.GetHeight());
-        Apply1D(image, temp, true);
-        Apply1D(temp, image, false);
+    std::string GetName() const override {
+        return "GaussianBlur";
+    }
+
+    size_t GetRadius() const override {
+        return static_cast<size_t>(radius_);
+    }
+
+    // The horizontal pass also covers the halo rows the vertical pass reads around [begin, end).
+    void ApplyRows(const Image& src, Image& dst, size_t begin, size_t end) const override {
+        const size_t first = begin > GetRadius() ? begin - GetRadius() : 0;
+        const size_t last = std::min(end + GetRadius(), src.GetHeight());
+        // The rows come from the buffer pool, so successive bands and calls reuse the same memory.
+        Image temp = Image::CreateUninitialized(src.GetWidth(), last - first);
+        if (!box_widths_.empty()) {
+            ApplyBoxesHorizontal(src, temp, first, last - first);
+            ApplyBoxesVertical(temp, last - first, dst, begin - first, begin, end - begin);
+            return;
+        }
+        ApplyHorizontal(src, temp, first, last - first);
+        ApplyVertical(temp, last - first, dst, begin - first, begin, end - begin);
     }
 
 private:
-    void Apply1D(const Image& src, Image& dst, bool horizontal) const {
-        for (size_t y = 0; y < src.GetHeight(); ++y) {
-            for (size_t x = 0; x < src.GetWidth(); ++x) {
-                float r = 0.0f;
-                float g = 0.0f;
-                float b = 0.0f;
-
-                for (int i = -radius_; i <= radius_; ++i) {
-                    int nx = 0;
-                    int ny = 0;
-
-                    if (horizontal) {
-                        nx = std::clamp(static_cast<int>(x) + i, 0, static_cast<int>(src.GetWidth()) - 1);
-                        ny = static_cast<int>(y);
-                    } else {
-                        nx = static_cast<int>(x);
-                        ny = std::clamp(static_cast<int>(y) + i, 0, static_cast<int>(src.GetHeight()) - 1);
+    // Reads are clamped to the row; pixels at least radius away from both ends skip the clamps.
+    void ApplyHorizontal(const Image& src, Image& dst, size_t src_y, size_t rows_count) const {
+        const size_t width = src.GetWidth();
+        const int last_x = static_cast<int>(width) - 1;
+        const size_t interior_begin = std::min(GetRadius(), width);
+        const size_t interior_end =
+            width > GetRadius() ? std::max(width - GetRadius(), interior_begin) : interior_begin;
+
+        for (size_t c = 0; c < Image::KChannels; ++c) {
+            for (size_t row = 0; row < rows_count; ++row) {
+                const float* src_row = src.ChannelRow(c, src_y + row);
+                float* dst_row = dst.ChannelRow(c, row);
+                auto clamped = [&](size_t x) {
+                    float sum = 0.0f;
+                    for (int i = -radius_; i <= radius_; ++i) {
+                        sum += src_row[std::clamp(static_cast<int>(x) + i, 0, last_x)] * kernel_[i + radius_];
                     }
+                    dst_row[x] = sum;
+                };
 
-                    const Pixel p = src.GetPixel(nx, ny);
-                    const float weight = kernel_[i + radius_];
-                    r += p.r * weight;
-                    g += p.g * weight;
-                    b += p.b * weight;
+                for (size_t x = 0; x < interior_begin; ++x) {
+                    clamped(x);
                 }
+                for (size_t x = interior_begin; x < interior_end; ++x) {
+                    const float* window = src_row + x - GetRadius();
+                    float sum = 0.0f;
+                    for (size_t i = 0; i < kernel_.size(); ++i) {
+                        sum += window[i] * kernel_[i];
+                    }
+                    dst_row[x] = sum;
+                }
+                for (size_t x = interior_end; x < width; ++x) {
+                    clamped(x);
+                }
+            }
+        }
+    }
+
+    // Accumulates whole rows tap by tap, in the same order as the horizontal pass sums a pixel,
+    // so every read streams along a row. Strips of columns keep the 2 * radius + 1 input rows of
+    // consecutive output rows in cache. src holds the band rows only, and reads are clamped to
+    // its first src_rows rows.
+    void ApplyVertical(const Image& src, size_t src_rows, Image& dst, size_t src_y, size_t dst_y,
+                       size_t rows_count) const {
+        const size_t width = src.GetWidth();
+        const int last_y = static_cast<int>(src_rows) - 1;
+
+        for (size_t c = 0; c < Image::KChannels; ++c) {
+            for (size_t x0 = 0; x0 < width; x0 += KStripColumns) {
+                const size_t columns = std::min(KStripColumns, width - x0);
+                for (size_t row = 0; row < rows_count; ++row) {
+                    const int y = static_cast<int>(src_y + row);
+                    float* dst_row = dst.ChannelRow(c, dst_y + row) + x0;
+                    std::fill_n(dst_row, columns, 0.0f);
+                    for (int i = -radius_; i <= radius_; ++i) {
+                        const float* src_row = src.ChannelRow(c, std::clamp(y + i, 0, last_y)) + x0;
+                        const float weight = kernel_[i + radius_];
+                        for (size_t x = 0; x < columns; ++x) {
+                            dst_row[x] += src_row[x] * weight;
+                        }
+                    }
+                }
+            }
+        }
+    }
 
-                dst.SetPixel(x, y, {r, g, b});
+    // The box passes run on one row at a time, padded by the radius with its edge pixels.
+    void ApplyBoxesHorizontal(const Image& src, Image& dst, size_t src_y, size_t rows_count) const {
+        const size_t width = src.GetWidth();
+        const size_t padded = width + 2 * GetRadius();
+        std::vector<int64_t> line(padded);
+        std::vector<int64_t> scratch(padded);
+
+        for (size_t c = 0; c < Image::KChannels; ++c) {
+            for (size_t row = 0; row < rows_count; ++row) {
+                const float* src_row = src.ChannelRow(c, src_y + row);
+                for (size_t i = 0; i < padded; ++i) {
+                    const size_t x = std::clamp(i, GetRadius(), width - 1 + GetRadius()) - GetRadius();
+                    line[i] = ToFixed(src_row[x]);
+                }
+                const std::vector<int64_t>& sums = RunBoxPasses(box_widths_, box_divisors_, line, scratch, padded, 1);
+                float* dst_row = dst.ChannelRow(c, row);
+                for (size_t x = 0; x < width; ++x) {
+                    dst_row[x] = static_cast<float>(static_cast<double>(sums[x]) * box_scale_);
+                }
+            }
+        }
+    }
+
+    // The box passes run down strips of columns, so the running sums are vectors of a whole strip.
+    // src holds the band rows only, and reads are clamped to its first src_rows rows.
+    void ApplyBoxesVertical(const Image& src, size_t src_rows, Image& dst, size_t src_y, size_t dst_y,
+                            size_t rows_count) const {
+        const size_t width = src.GetWidth();
+        const size_t padded = rows_count + 2 * GetRadius();
+        const int last_y = static_cast<int>(src_rows) - 1;
+        std::vector<int64_t> block(padded * KStripColumns);
+        std::vector<int64_t> scratch(padded * KStripColumns);
+
+        for (size_t c = 0; c < Image::KChannels; ++c) {
+            for (size_t x0 = 0; x0 < width; x0 += KStripColumns) {
+                const size_t columns = std::min(KStripColumns, width - x0);
+                for (size_t i = 0; i < padded; ++i) {
+                    const int y = std::clamp(static_cast<int>(src_y + i) - radius_, 0, last_y);
+                    const float* src_row = src.ChannelRow(c, static_cast<size_t>(y)) + x0;
+                    for (size_t x = 0; x < columns; ++x) {
+                        block[i * columns + x] = ToFixed(src_row[x]);
+                    }
+                }
+                const std::vector<int64_t>& sums =
+                    RunBoxPasses(box_widths_, box_divisors_, block, scratch, padded, columns);
+                for (size_t row = 0; row < rows_count; ++row) {
+                    float* dst_row = dst.ChannelRow(c, dst_y + row) + x0;
+                    for (size_t x = 0; x < columns; ++x) {
+                        dst_row[x] = static_cast<float>(static_cast<double>(sums[row * columns + x]) * box_scale_);
+                    }
+                }
             }
         }
     }
@@ -66,6 +282,11 @@ private:
     float sigma_;
     int radius_;
     std::vector<float> kernel_;
+    // Empty unless sigma is large enough for the box cascade.
+    std::vector<size_t> box_widths_;
+    // What the sums are divided by after each pass, so they never overflow.
+    std::vector<int64_t> box_divisors_;
+    double box_scale_ = 0.0;
 };
 
 FilterPtr CreateGaussianBlurFilter(float sigma) {
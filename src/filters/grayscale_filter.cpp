@@ -1,6 +1,5 @@
 #include "filter.h"
 #include "image.h"
-#include <algorithm>  // для std::clamp
 
 namespace constants {
 constexpr float KRedLuminance = 0.299f;
@@ -8,23 +7,20 @@ constexpr float KGreenLuminance = 0.587f;
 constexpr float KBlueLuminance = 0.114f;
 }  // namespace constants
 
-class GrayscaleFilter : public IFilter {
+class GrayscaleFilter : public PointFilter {
 public:
-    void Apply(Image& image) const override {
-        const size_t width = image.GetWidth();
-        const size_t height = image.GetHeight();
-
-        for (size_t y = 0; y < height; ++y) {
-            for (size_t x = 0; x < width; ++x) {
-                const Pixel p = image.GetPixel(x, y);
-                float gray =
-                    constants::KRedLuminance * p.r + constants::KGreenLuminance * p.g + constants::KBlueLuminance * p.b;
-
-                gray = std::clamp(gray, 0.0f, 1.0f);
+    GrayscaleFilter() : PointFilter({MakeOp()}, "Grayscale") {
+    }
 
-                image.SetPixel(x, y, {gray, gray, gray});
-            }
+private:
+    static PointOp MakeOp() {
+        PointOp op{};
+        for (auto& row : op.matrix) {
+            row[0] = constants::KRedLuminance;
+            row[1] = constants::KGreenLuminance;
+            row[2] = constants::KBlueLuminance;
         }
+        return op;
     }
 };
 
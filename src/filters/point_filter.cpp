@@ -0,0 +1,122 @@
+#include "filter.h"
+#include "point_kernels.h"
+#include <algorithm>
+#include <utility>
+
+namespace {
+// Pixels run through all fused stages while they are still in L1.
+constexpr size_t KChunkPixels = 512;
+// Allows for the rounding of coefficients such as the luminance weights, which sum to 1.
+constexpr double KRangeTolerance = 1e-6;
+
+// True if the stage cannot produce values outside [0, 1] from inputs in [0, 1],
+// i.e. its saturation is a no-op and the next stage may be folded into it.
+bool KeepsUnitRange(const PointOp& op) {
+    if (op.quantize) {
+        return false;
+    }
+    for (size_t c = 0; c < 3; ++c) {
+        double low = op.offset[c];
+        double high = op.offset[c];
+        for (size_t k = 0; k < 3; ++k) {
+            low += std::min(0.0, static_cast<double>(op.matrix[c][k]));
+            high += std::max(0.0, static_cast<double>(op.matrix[c][k]));
+        }
+        if (low < -KRangeTolerance || high > 1.0 + KRangeTolerance) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The stage equivalent to applying first and then second.
+PointOp Compose(const PointOp& first, const PointOp& second) {
+    PointOp result{};
+    for (size_t c = 0; c < 3; ++c) {
+        double offset = second.offset[c];
+        for (size_t k = 0; k < 3; ++k) {
+            double sum = 0.0;
+            for (size_t j = 0; j < 3; ++j) {
+                sum += static_cast<double>(second.matrix[c][j]) * first.matrix[j][k];
+            }
+            result.matrix[c][k] = static_cast<float>(sum);
+            offset += static_cast<double>(second.matrix[c][k]) * first.offset[k];
+        }
+        result.offset[c] = static_cast<float>(offset);
+    }
+    result.quantize = second.quantize;
+    return result;
+}
+}  // namespace
+
+PointFilter::PointFilter(std::vector<PointOp> stages, std::string name)
+    : stages_(std::move(stages)), name_(std::move(name)) {
+}
+
+void PointFilter::ApplyRows(const Image& src, Image& dst, size_t begin, size_t end) const {
+    const size_t width = src.GetWidth();
+    const bool bytes = src.GetFormat() == PixelFormat::UInt8;
+    float scratch[Image::KChannels][KChunkPixels];
+
+    for (size_t y = begin; y < end; ++y) {
+        for (size_t x = 0; x < width; x += KChunkPixels) {
+            const size_t count = std::min(KChunkPixels, width - x);
+            point_kernels::Rows out = {scratch[0], scratch[1], scratch[2]};
+            point_kernels::ConstRows in = {scratch[0], scratch[1], scratch[2]};
+            if (bytes) {
+                for (size_t c = 0; c < Image::KChannels; ++c) {
+                    const uint8_t* row = src.ChannelRow<uint8_t>(c, y) + x;
+                    for (size_t i = 0; i < count; ++i) {
+                        scratch[c][i] = pixel::FromByte(row[i]);
+                    }
+                }
+            } else {
+                out = {dst.ChannelRow(0, y) + x, dst.ChannelRow(1, y) + x, dst.ChannelRow(2, y) + x};
+                in = {src.ChannelRow(0, y) + x, src.ChannelRow(1, y) + x, src.ChannelRow(2, y) + x};
+            }
+
+            for (const PointOp& stage : stages_) {
+                point_kernels::ApplyPointOp(stage, in, out, count);
+                in = {out.r, out.g, out.b};
+            }
+
+            if (bytes) {
+                for (size_t c = 0; c < Image::KChannels; ++c) {
+                    uint8_t* row = dst.ChannelRow<uint8_t>(c, y) + x;
+                    for (size_t i = 0; i < count; ++i) {
+                        row[i] = pixel::ToByte(scratch[c][i]);
+                    }
+                }
+            }
+        }
+    }
+}
+
+std::vector<FilterPtr> FusePointFilters(const std::vector<FilterPtr>& filters) {
+    std::vector<FilterPtr> result;
+
+    for (size_t i = 0; i < filters.size();) {
+        size_t run_end = i;
+        std::vector<PointOp> stages;
+        std::string name;
+        while (run_end < filters.size() && filters[run_end]->GetPointOp() != nullptr) {
+            const PointOp& op = *filters[run_end]->GetPointOp();
+            name += (name.empty() ? "" : "+") + filters[run_end]->GetName();
+            if (!stages.empty() && KeepsUnitRange(stages.back())) {
+                stages.back() = Compose(stages.back(), op);
+            } else {
+                stages.push_back(op);
+            }
+            ++run_end;
+        }
+
+        if (run_end - i > 1) {
+            result.push_back(std::make_shared<PointFilter>(std::move(stages), std::move(name)));
+            i = run_end;
+        } else {
+            result.push_back(filters[i]);
+            ++i;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,92 @@
+#include "point_kernels.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iterator>
+#include <string>
+
+namespace point_kernels {
+
+#ifdef IMAGE_PROCESSOR_X86_KERNELS
+namespace sse42 {
+void ApplyPointOp(const PointOp& op, ConstRows src, Rows dst, size_t count);
+}  // namespace sse42
+namespace avx2 {
+void ApplyPointOp(const PointOp& op, ConstRows src, Rows dst, size_t count);
+}  // namespace avx2
+namespace avx512 {
+void ApplyPointOp(const PointOp& op, ConstRows src, Rows dst, size_t count);
+}  // namespace avx512
+#endif
+
+namespace scalar {
+
+void ApplyPointOp(const PointOp& op, ConstRows src, Rows dst, size_t count) {
+    constexpr float KMaxColorValue = 255.0f;
+    float* const out[3] = {dst.r, dst.g, dst.b};
+
+    for (size_t x = 0; x < count; ++x) {
+        const float r = src.r[x];
+        const float g = src.g[x];
+        const float b = src.b[x];
+        for (size_t c = 0; c < 3; ++c) {
+            float v = op.matrix[c][0] * r + op.matrix[c][1] * g + op.matrix[c][2] * b + op.offset[c];
+            if (op.quantize) {
+                v = std::round(v * KMaxColorValue) / KMaxColorValue;
+            }
+            out[c][x] = std::min(1.0f, std::max(0.0f, v));
+        }
+    }
+}
+
+}  // namespace scalar
+
+namespace {
+
+struct KernelTable {
+    const char* name;
+    void (*point_op)(const PointOp&, ConstRows, Rows, size_t);
+};
+
+KernelTable SelectKernels() {
+    const KernelTable scalar_table = {"scalar", scalar::ApplyPointOp};
+#ifdef IMAGE_PROCESSOR_X86_KERNELS
+    const KernelTable tables[] = {
+        {"avx512", avx512::ApplyPointOp},
+        {"avx2", avx2::ApplyPointOp},
+        {"sse4.2", sse42::ApplyPointOp},
+    };
+    const bool supported[] = {
+        __builtin_cpu_supports("avx512f") != 0,
+        __builtin_cpu_supports("avx2") != 0,
+        __builtin_cpu_supports("sse4.2") != 0,
+    };
+
+    const char* requested = std::getenv("IMAGE_PROCESSOR_ISA");
+    bool allowed = requested == nullptr;
+    for (size_t i = 0; i < std::size(tables); ++i) {
+        allowed = allowed || std::string(requested) == tables[i].name;
+        if (allowed && supported[i]) {
+            return tables[i];
+        }
+    }
+#endif
+    return scalar_table;
+}
+
+const KernelTable& Kernels() {
+    static const KernelTable table = SelectKernels();
+    return table;
+}
+
+}  // namespace
+
+void ApplyPointOp(const PointOp& op, ConstRows src, Rows dst, size_t count) {
+    Kernels().point_op(op, src, dst, count);
+}
+
+const char* GetInstructionSet() {
+    return Kernels().name;
+}
+
+}  // namespace point_kernels
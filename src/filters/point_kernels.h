@@ -0,0 +1,35 @@
+#pragma once
+#include "filter.h"
+#include <cstddef>
+
+// Row kernels for point operations on planar images. Each call processes `count` pixels;
+// output rows may alias the input rows. The implementation is picked once at startup from the
+// instruction sets the CPU supports (AVX-512, AVX2, SSE4.2 or plain C++); setting
+// IMAGE_PROCESSOR_ISA to "scalar", "sse4.2", "avx2" or "avx512" caps the choice.
+// All implementations produce bit-identical results.
+namespace point_kernels {
+
+struct ConstRows {
+    const float* r;
+    const float* g;
+    const float* b;
+};
+
+struct Rows {
+    float* r;
+    float* g;
+    float* b;
+};
+
+// Every output channel is evaluated as ((m[c][0] * r + m[c][1] * g) + m[c][2] * b) + offset[c];
+// quantization rounds v * 255 half away from zero, like std::round, and divides by 255 again.
+void ApplyPointOp(const PointOp& op, ConstRows src, Rows dst, size_t count);
+
+const char* GetInstructionSet();
+
+namespace scalar {
+// The plain C++ kernel, which the vector kernels are tested against.
+void ApplyPointOp(const PointOp& op, ConstRows src, Rows dst, size_t count);
+}  // namespace scalar
+
+}  // namespace point_kernels
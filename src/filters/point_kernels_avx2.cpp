@@ -0,0 +1,64 @@
+#include "point_kernels_simd.h"
+#include <immintrin.h>
+
+namespace {
+struct Avx2 {
+    using Vec = __m256;
+    static constexpr size_t KLanes = 8;
+
+    static Vec Load(const float* p) {
+        return _mm256_loadu_ps(p);
+    }
+    static Vec LoadOne(const float* p) {
+        return _mm256_castps128_ps256(_mm_load_ss(p));
+    }
+    static void Store(float* p, Vec v) {
+        _mm256_storeu_ps(p, v);
+    }
+    static void StoreOne(float* p, Vec v) {
+        _mm_store_ss(p, _mm256_castps256_ps128(v));
+    }
+    static Vec Set(float value) {
+        return _mm256_set1_ps(value);
+    }
+    static Vec Add(Vec a, Vec b) {
+        return _mm256_add_ps(a, b);
+    }
+    static Vec Sub(Vec a, Vec b) {
+        return _mm256_sub_ps(a, b);
+    }
+    static Vec Mul(Vec a, Vec b) {
+        return _mm256_mul_ps(a, b);
+    }
+    static Vec Div(Vec a, Vec b) {
+        return _mm256_div_ps(a, b);
+    }
+    static Vec Min(Vec a, Vec b) {
+        return _mm256_min_ps(a, b);
+    }
+    static Vec Max(Vec a, Vec b) {
+        return _mm256_max_ps(a, b);
+    }
+    static Vec Trunc(Vec v) {
+        return _mm256_round_ps(v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+    }
+    static Vec Abs(Vec v) {
+        return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), v);
+    }
+    static Vec CopySign(Vec magnitude, Vec sign) {
+        const Vec sign_mask = _mm256_set1_ps(-0.0f);
+        return _mm256_or_ps(_mm256_andnot_ps(sign_mask, magnitude), _mm256_and_ps(sign_mask, sign));
+    }
+    static Vec AddWhereGreaterEqual(Vec base, Vec addend, Vec a, Vec b) {
+        return _mm256_add_ps(base, _mm256_and_ps(_mm256_cmp_ps(a, b, _CMP_GE_OQ), addend));
+    }
+};
+}  // namespace
+
+namespace point_kernels::avx2 {
+
+void ApplyPointOp(const PointOp& op, ConstRows src, Rows dst, size_t count) {
+    RunPointOp<Avx2>(op, src, dst, count);
+}
+
+}  // namespace point_kernels::avx2
@@ -0,0 +1,66 @@
+#include "point_kernels_simd.h"
+#include <immintrin.h>
+
+namespace {
+struct Avx512 {
+    using Vec = __m512;
+    static constexpr size_t KLanes = 16;
+
+    static Vec Load(const float* p) {
+        return _mm512_loadu_ps(p);
+    }
+    static Vec LoadOne(const float* p) {
+        return _mm512_maskz_loadu_ps(1, p);
+    }
+    static void Store(float* p, Vec v) {
+        _mm512_storeu_ps(p, v);
+    }
+    static void StoreOne(float* p, Vec v) {
+        _mm512_mask_storeu_ps(p, 1, v);
+    }
+    static Vec Set(float value) {
+        return _mm512_set1_ps(value);
+    }
+    static Vec Add(Vec a, Vec b) {
+        return _mm512_add_ps(a, b);
+    }
+    static Vec Sub(Vec a, Vec b) {
+        return _mm512_sub_ps(a, b);
+    }
+    static Vec Mul(Vec a, Vec b) {
+        return _mm512_mul_ps(a, b);
+    }
+    static Vec Div(Vec a, Vec b) {
+        return _mm512_div_ps(a, b);
+    }
+    static Vec Min(Vec a, Vec b) {
+        return _mm512_min_ps(a, b);
+    }
+    static Vec Max(Vec a, Vec b) {
+        return _mm512_max_ps(a, b);
+    }
+    static Vec Trunc(Vec v) {
+        return _mm512_roundscale_ps(v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+    }
+    static Vec Abs(Vec v) {
+        return _mm512_abs_ps(v);
+    }
+    static Vec CopySign(Vec magnitude, Vec sign) {
+        const __m512i sign_mask = _mm512_set1_epi32(static_cast<int>(0x80000000u));
+        const __m512i bits = _mm512_or_si512(_mm512_andnot_si512(sign_mask, _mm512_castps_si512(magnitude)),
+                                             _mm512_and_si512(sign_mask, _mm512_castps_si512(sign)));
+        return _mm512_castsi512_ps(bits);
+    }
+    static Vec AddWhereGreaterEqual(Vec base, Vec addend, Vec a, Vec b) {
+        return _mm512_mask_add_ps(base, _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ), base, addend);
+    }
+};
+}  // namespace
+
+namespace point_kernels::avx512 {
+
+void ApplyPointOp(const PointOp& op, ConstRows src, Rows dst, size_t count) {
+    RunPointOp<Avx512>(op, src, dst, count);
+}
+
+}  // namespace point_kernels::avx512
@@ -0,0 +1,82 @@
+#pragma once
+#include "point_kernels.h"
+
+// Vector bodies of the point kernels, written against a traits type V that wraps one
+// instruction set. Included only by the per-ISA translation units, each compiled with its
+// own target flags, so everything here has internal linkage.
+namespace {
+
+template <class V>
+inline typename V::Vec Saturate(typename V::Vec v) {
+    return V::Min(V::Max(v, V::Set(0.0f)), V::Set(1.0f));
+}
+
+// std::round: truncate, then step away from zero when the dropped fraction is at least one half.
+template <class V>
+inline typename V::Vec RoundHalfAwayFromZero(typename V::Vec v) {
+    const typename V::Vec truncated = V::Trunc(v);
+    const typename V::Vec fraction = V::Abs(V::Sub(v, truncated));
+    return V::AddWhereGreaterEqual(truncated, V::CopySign(V::Set(1.0f), v), fraction, V::Set(0.5f));
+}
+
+template <class V>
+struct PointOpVectors {
+    explicit PointOpVectors(const PointOp& op) {
+        for (size_t c = 0; c < 3; ++c) {
+            for (size_t k = 0; k < 3; ++k) {
+                matrix[c][k] = V::Set(op.matrix[c][k]);
+            }
+            offset[c] = V::Set(op.offset[c]);
+        }
+    }
+
+    typename V::Vec matrix[3][3];
+    typename V::Vec offset[3];
+};
+
+template <class V, bool Quantize>
+inline typename V::Vec PointOpLanes(const PointOpVectors<V>& op, size_t c, typename V::Vec r, typename V::Vec g,
+                                    typename V::Vec b) {
+    typename V::Vec v = V::Add(V::Mul(op.matrix[c][0], r), V::Mul(op.matrix[c][1], g));
+    v = V::Add(V::Add(v, V::Mul(op.matrix[c][2], b)), op.offset[c]);
+    if constexpr (Quantize) {
+        const typename V::Vec max_color = V::Set(255.0f);
+        v = V::Div(RoundHalfAwayFromZero<V>(V::Mul(v, max_color)), max_color);
+    }
+    return Saturate<V>(v);
+}
+
+template <class V, bool Quantize>
+inline void PointOpKernel(const PointOp& op, point_kernels::ConstRows src, point_kernels::Rows dst, size_t count) {
+    const PointOpVectors<V> vectors(op);
+    float* const out[3] = {dst.r, dst.g, dst.b};
+
+    size_t x = 0;
+    for (; x + V::KLanes <= count; x += V::KLanes) {
+        const typename V::Vec r = V::Load(src.r + x);
+        const typename V::Vec g = V::Load(src.g + x);
+        const typename V::Vec b = V::Load(src.b + x);
+        for (size_t c = 0; c < 3; ++c) {
+            V::Store(out[c] + x, PointOpLanes<V, Quantize>(vectors, c, r, g, b));
+        }
+    }
+    for (; x < count; ++x) {
+        const typename V::Vec r = V::LoadOne(src.r + x);
+        const typename V::Vec g = V::LoadOne(src.g + x);
+        const typename V::Vec b = V::LoadOne(src.b + x);
+        for (size_t c = 0; c < 3; ++c) {
+            V::StoreOne(out[c] + x, PointOpLanes<V, Quantize>(vectors, c, r, g, b));
+        }
+    }
+}
+
+template <class V>
+inline void RunPointOp(const PointOp& op, point_kernels::ConstRows src, point_kernels::Rows dst, size_t count) {
+    if (op.quantize) {
+        PointOpKernel<V, true>(op, src, dst, count);
+    } else {
+        PointOpKernel<V, false>(op, src, dst, count);
+    }
+}
+
+}  // namespace
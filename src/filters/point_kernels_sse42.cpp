@@ -0,0 +1,64 @@
+#include "point_kernels_simd.h"
+#include <immintrin.h>
+
+namespace {
+struct Sse42 {
+    using Vec = __m128;
+    static constexpr size_t KLanes = 4;
+
+    static Vec Load(const float* p) {
+        return _mm_loadu_ps(p);
+    }
+    static Vec LoadOne(const float* p) {
+        return _mm_load_ss(p);
+    }
+    static void Store(float* p, Vec v) {
+        _mm_storeu_ps(p, v);
+    }
+    static void StoreOne(float* p, Vec v) {
+        _mm_store_ss(p, v);
+    }
+    static Vec Set(float value) {
+        return _mm_set1_ps(value);
+    }
+    static Vec Add(Vec a, Vec b) {
+        return _mm_add_ps(a, b);
+    }
+    static Vec Sub(Vec a, Vec b) {
+        return _mm_sub_ps(a, b);
+    }
+    static Vec Mul(Vec a, Vec b) {
+        return _mm_mul_ps(a, b);
+    }
+    static Vec Div(Vec a, Vec b) {
+        return _mm_div_ps(a, b);
+    }
+    static Vec Min(Vec a, Vec b) {
+        return _mm_min_ps(a, b);
+    }
+    static Vec Max(Vec a, Vec b) {
+        return _mm_max_ps(a, b);
+    }
+    static Vec Trunc(Vec v) {
+        return _mm_round_ps(v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+    }
+    static Vec Abs(Vec v) {
+        return _mm_andnot_ps(_mm_set1_ps(-0.0f), v);
+    }
+    static Vec CopySign(Vec magnitude, Vec sign) {
+        const Vec sign_mask = _mm_set1_ps(-0.0f);
+        return _mm_or_ps(_mm_andnot_ps(sign_mask, magnitude), _mm_and_ps(sign_mask, sign));
+    }
+    static Vec AddWhereGreaterEqual(Vec base, Vec addend, Vec a, Vec b) {
+        return _mm_add_ps(base, _mm_and_ps(_mm_cmpge_ps(a, b), addend));
+    }
+};
+}  // namespace
+
+namespace point_kernels::sse42 {
+
+void ApplyPointOp(const PointOp& op, ConstRows src, Rows dst, size_t count) {
+    RunPointOp<Sse42>(op, src, dst, count);
+}
+
+}  // namespace point_kernels::sse42
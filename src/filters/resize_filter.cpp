@@ -0,0 +1,294 @@
+#include "filter.h"
+#include "image.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+constexpr double KPi = 3.14159265358979323846;
+constexpr double KLanczosLobes = 3.0;
+constexpr double KTriangleRadius = 1.0;
+constexpr float KMinValue = 0.0f;
+constexpr float KMaxValue = 1.0f;
+// Outputs have to fit the signed 32-bit sizes of a BMP header and a pixel count whose buffers
+// can plausibly be allocated; larger ones are refused before any weights are computed.
+constexpr double KMaxOutputSide = INT32_MAX;
+constexpr double KMaxOutputPixels = static_cast<double>(uint64_t{1} << 30);
+
+// The input coordinates every output coordinate of one axis reads, and their weights.
+struct AxisWeights {
+    // First input coordinate of each output coordinate.
+    std::vector<size_t> first;
+    // Weights of output coordinate o are weights[offsets[o]] to weights[offsets[o + 1]].
+    std::vector<size_t> offsets;
+    std::vector<float> weights;
+    // The lowest first coordinate of this and all later outputs, and the highest end coordinate
+    // of this and all earlier ones, so ranges of outputs map to input ranges that only move on.
+    std::vector<size_t> span_first;
+    std::vector<size_t> span_last;
+};
+
+double Sinc(double x) {
+    if (x == 0.0) {
+        return 1.0;
+    }
+    x *= KPi;
+    return std::sin(x) / x;
+}
+
+double Lanczos(double x) {
+    return std::abs(x) < KLanczosLobes ? Sinc(x) * Sinc(x / KLanczosLobes) : 0.0;
+}
+
+double Triangle(double x) {
+    return std::max(0.0, KTriangleRadius - std::abs(x));
+}
+
+// Shrinking uses Lanczos-3 stretched over the input pixels an output pixel covers, which keeps
+// detail without aliasing; enlarging interpolates linearly, which does not ring. Taps past the
+// border are dropped and the rest renormalised.
+AxisWeights ComputeWeights(size_t in, size_t out) {
+    const double scale = static_cast<double>(in) / static_cast<double>(out);
+    const bool shrinking = in > out;
+    const double stretch = std::max(scale, 1.0);
+    const double radius = (shrinking ? KLanczosLobes : KTriangleRadius) * stretch;
+    const auto last_input = static_cast<double>(in - 1);
+
+    AxisWeights axis;
+    axis.offsets.push_back(0);
+    std::vector<double> taps;
+    for (size_t o = 0; o < out; ++o) {
+        const double center = (static_cast<double>(o) + 0.5) * scale - 0.5;
+        auto lo = static_cast<size_t>(std::clamp(std::ceil(center - radius), 0.0, last_input));
+        auto hi = static_cast<size_t>(std::clamp(std::floor(center + radius), 0.0, last_input));
+        taps.clear();
+        double sum = 0.0;
+        for (size_t i = lo; i <= hi; ++i) {
+            const double x = (static_cast<double>(i) - center) / stretch;
+            taps.push_back(shrinking ? Lanczos(x) : Triangle(x));
+            sum += taps.back();
+        }
+        size_t skip_front = 0;
+        while (skip_front + 1 < taps.size() && taps[skip_front] == 0.0) {
+            ++skip_front;
+        }
+        while (taps.size() > skip_front + 1 && taps.back() == 0.0) {
+            taps.pop_back();
+        }
+        axis.first.push_back(lo + skip_front);
+        for (size_t k = skip_front; k < taps.size(); ++k) {
+            axis.weights.push_back(static_cast<float>(taps[k] / sum));
+        }
+        axis.offsets.push_back(axis.weights.size());
+    }
+
+    axis.span_first.resize(out);
+    axis.span_last.resize(out);
+    size_t first = in;
+    for (size_t o = out; o-- > 0;) {
+        first = std::min(first, axis.first[o]);
+        axis.span_first[o] = first;
+    }
+    size_t last = 0;
+    for (size_t o = 0; o < out; ++o) {
+        last = std::max(last, axis.first[o] + axis.offsets[o + 1] - axis.offsets[o]);
+        axis.span_last[o] = last;
+    }
+    return axis;
+}
+
+// Shrinks by whole factors: every output pixel is the mean of an fx by fy block.
+class AreaPlan : public ResamplePlan {
+public:
+    AreaPlan(size_t width, size_t height, size_t fx, size_t fy)
+        : width_(width), height_(height), fx_(fx), fy_(fy), scale_(1.0f / static_cast<float>(fx * fy)) {
+    }
+
+    size_t GetWidth() const override {
+        return width_;
+    }
+
+    size_t GetHeight() const override {
+        return height_;
+    }
+
+    RowSpan GetInputRows(size_t begin, size_t end) const override {
+        return {begin * fy_, end * fy_};
+    }
+
+    // The rows of a block are summed first, element by element, and the columns of the sum then.
+    void ApplyRows(const Image& src, size_t src_y, Image& dst, size_t dst_y, size_t begin,
+                   size_t end) const override {
+        const size_t in_width = width_ * fx_;
+        std::vector<float> sums(in_width);
+        for (size_t c = 0; c < Image::KChannels; ++c) {
+            for (size_t y = begin; y < end; ++y) {
+                const size_t row = y * fy_ - src_y;
+                std::copy_n(src.ChannelRow(c, row), in_width, sums.data());
+                for (size_t k = 1; k < fy_; ++k) {
+                    const float* src_row = src.ChannelRow(c, row + k);
+                    for (size_t x = 0; x < in_width; ++x) {
+                        sums[x] += src_row[x];
+                    }
+                }
+                SumColumns(sums.data(), dst.ChannelRow(c, dst_y + y - begin));
+            }
+        }
+    }
+
+private:
+    void SumColumns(const float* sums, float* dst_row) const {
+        if (fx_ == 1) {
+            for (size_t x = 0; x < width_; ++x) {
+                dst_row[x] = sums[x] * scale_;
+            }
+        } else if (fx_ == 2) {
+            for (size_t x = 0; x < width_; ++x) {
+                dst_row[x] = (sums[2 * x] + sums[2 * x + 1]) * scale_;
+            }
+        } else {
+            for (size_t x = 0; x < width_; ++x) {
+                const float* block = sums + x * fx_;
+                float sum = 0.0f;
+                for (size_t k = 0; k < fx_; ++k) {
+                    sum += block[k];
+                }
+                dst_row[x] = sum * scale_;
+            }
+        }
+    }
+
+    size_t width_;
+    size_t height_;
+    size_t fx_;
+    size_t fy_;
+    float scale_;
+};
+
+// Combines the input rows of an output row first, so the per-pixel horizontal taps only run on
+// output rows.
+class SeparablePlan : public ResamplePlan {
+public:
+    SeparablePlan(AxisWeights columns, AxisWeights rows) : columns_(std::move(columns)), rows_(std::move(rows)) {
+    }
+
+    size_t GetWidth() const override {
+        return columns_.first.size();
+    }
+
+    size_t GetHeight() const override {
+        return rows_.first.size();
+    }
+
+    RowSpan GetInputRows(size_t begin, size_t end) const override {
+        return {rows_.span_first[begin], rows_.span_last[end - 1]};
+    }
+
+    void ApplyRows(const Image& src, size_t src_y, Image& dst, size_t dst_y, size_t begin,
+                   size_t end) const override {
+        const size_t in_width = src.GetWidth();
+        const size_t width = GetWidth();
+        std::vector<float> sums(in_width);
+        for (size_t c = 0; c < Image::KChannels; ++c) {
+            for (size_t y = begin; y < end; ++y) {
+                // Whole input rows are accumulated tap by tap, so every read streams along a row.
+                const float* weights = rows_.weights.data() + rows_.offsets[y];
+                const size_t taps = rows_.offsets[y + 1] - rows_.offsets[y];
+                const size_t first = rows_.first[y] - src_y;
+                const float* src_row = src.ChannelRow(c, first);
+                for (size_t x = 0; x < in_width; ++x) {
+                    sums[x] = src_row[x] * weights[0];
+                }
+                for (size_t k = 1; k < taps; ++k) {
+                    src_row = src.ChannelRow(c, first + k);
+                    for (size_t x = 0; x < in_width; ++x) {
+                        sums[x] += src_row[x] * weights[k];
+                    }
+                }
+
+                float* dst_row = dst.ChannelRow(c, dst_y + y - begin);
+                for (size_t x = 0; x < width; ++x) {
+                    const float* window = sums.data() + columns_.first[x];
+                    const float* column_weights = columns_.weights.data() + columns_.offsets[x];
+                    const size_t column_taps = columns_.offsets[x + 1] - columns_.offsets[x];
+                    float sum = 0.0f;
+                    for (size_t k = 0; k < column_taps; ++k) {
+                        sum += window[k] * column_weights[k];
+                    }
+                    // Negative Lanczos lobes overshoot at hard edges.
+                    dst_row[x] = std::min(std::max(sum, KMinValue), KMaxValue);
+                }
+            }
+        }
+    }
+
+private:
+    AxisWeights columns_;
+    AxisWeights rows_;
+};
+}  // namespace
+
+void ResampleFilter::Apply(Image& image) const {
+    if (!Accepts(image.GetFormat())) {
+        image.SetFormat(PixelFormat::Float32);
+    }
+    image.SetLayout(PixelLayout::Planar);
+    const std::unique_ptr<ResamplePlan> plan = Prepare(image.GetWidth(), image.GetHeight());
+    Image result = Image::CreateUninitialized(plan->GetWidth(), plan->GetHeight());
+    plan->ApplyRows(image, 0, result, 0, 0, plan->GetHeight());
+    image = std::move(result);
+}
+
+// Sizes that divide the input evenly take the box average; all others the separable filters.
+class ResizeFilter : public ResampleFilter {
+public:
+    ResizeFilter(size_t width, size_t height) : width_(width), height_(height) {
+    }
+
+    explicit ResizeFilter(float factor) : width_(0), height_(0), factor_(factor) {
+    }
+
+    std::string GetName() const override {
+        return "Resize";
+    }
+
+    std::unique_ptr<ResamplePlan> Prepare(size_t width, size_t height) const override {
+        const double scaled_width = factor_ ? Scale(width) : static_cast<double>(width_);
+        const double scaled_height = factor_ ? Scale(height) : static_cast<double>(height_);
+        if (scaled_width > KMaxOutputSide || scaled_height > KMaxOutputSide ||
+            scaled_width * scaled_height > KMaxOutputPixels) {
+            throw std::runtime_error("Resized image would be too large: at most " +
+                                     std::to_string(static_cast<int64_t>(KMaxOutputSide)) + " pixels per side and " +
+                                     std::to_string(static_cast<int64_t>(KMaxOutputPixels)) + " pixels in total");
+        }
+        const auto out_width = static_cast<size_t>(scaled_width);
+        const auto out_height = static_cast<size_t>(scaled_height);
+        if (width % out_width == 0 && height % out_height == 0) {
+            return std::make_unique<AreaPlan>(out_width, out_height, width / out_width, height / out_height);
+        }
+        return std::make_unique<SeparablePlan>(ComputeWeights(width, out_width), ComputeWeights(height, out_height));
+    }
+
+private:
+    // Rounded, but not converted, so that sizes beyond any integer type can still be refused.
+    double Scale(size_t size) const {
+        return std::max(1.0, std::round(static_cast<double>(size) * *factor_));
+    }
+
+    size_t width_;
+    size_t height_;
+    std::optional<float> factor_;
+};
+
+FilterPtr CreateResizeFilter(size_t width, size_t height) {
+    return std::make_shared<ResizeFilter>(width, height);
+}
+
+FilterPtr CreateScaleFilter(float factor) {
+    return std::make_shared<ResizeFilter>(factor);
+}
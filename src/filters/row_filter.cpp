@@ -0,0 +1,20 @@
+#include "filter.h"
+#include <utility>
+
+void RowFilter::Apply(Image& image) const {
+    if (!Accepts(image.GetFormat())) {
+        image.SetFormat(PixelFormat::Float32);
+    }
+    image.SetLayout(PixelLayout::Planar);
+    if (GetRadius() == 0) {
+        ApplyRows(image, image, 0, image.GetHeight());
+        return;
+    }
+    Image result = CreateOutput(image);
+    ApplyRows(image, result, 0, image.GetHeight());
+    image = std::move(result);
+}
+
+Image RowFilter::CreateOutput(const Image& src) const {
+    return Image::CreateUninitialized(src.GetWidth(), src.GetHeight(), PixelLayout::Planar, src.GetFormat());
+}
@@ -1,10 +1,113 @@
 #include "image.h"
+#include "buffer_pool.h"
 #include <algorithm>
+#include <cstring>
+#include <new>
+#include <type_traits>
 
-Image::Image(size_t width, size_t height) : width_(width), height_(height), data_(width * height) {
+namespace {
+size_t AlignedRowBytes(size_t bytes) {
+    return (bytes + Image::KRowAlignment - 1) / Image::KRowAlignment * Image::KRowAlignment;
+}
+
+// Converts one planar row between formats; integer formats are rescaled through floats.
+template <typename From, typename To>
+void ConvertRow(const From* src, To* dst, size_t width) {
+    for (size_t x = 0; x < width; ++x) {
+        float value = 0.0f;
+        if constexpr (std::is_same_v<From, float>) {
+            value = src[x];
+        } else if constexpr (std::is_same_v<From, uint8_t>) {
+            value = pixel::FromByte(src[x]);
+        } else {
+            value = pixel::FromWord(src[x]);
+        }
+
+        if constexpr (std::is_same_v<To, float>) {
+            dst[x] = value;
+        } else if constexpr (std::is_same_v<To, uint8_t>) {
+            dst[x] = pixel::ToByte(value);
+        } else {
+            dst[x] = pixel::ToWord(value);
+        }
+    }
+}
+
+template <typename From>
+void ConvertPlanes(const Image& src, Image& dst) {
+    const size_t planes = src.GetLayout() == PixelLayout::Mono ? 1 : Image::KChannels;
+    for (size_t c = 0; c < planes; ++c) {
+        for (size_t y = 0; y < src.GetHeight(); ++y) {
+            const From* row = src.ChannelRow<From>(c, y);
+            switch (dst.GetFormat()) {
+                case PixelFormat::Float32:
+                    ConvertRow(row, dst.ChannelRow<float>(c, y), src.GetWidth());
+                    break;
+                case PixelFormat::UInt16:
+                    ConvertRow(row, dst.ChannelRow<uint16_t>(c, y), src.GetWidth());
+                    break;
+                case PixelFormat::UInt8:
+                    ConvertRow(row, dst.ChannelRow<uint8_t>(c, y), src.GetWidth());
+                    break;
+            }
+        }
+    }
+}
+}  // namespace
+
+void Image::BufferDeleter::operator()(uint8_t* data) const {
+    if (release != nullptr) {
+        release(data, bytes);
+    } else {
+        BufferPool::GetInstance().Release(data, bytes);
+    }
+}
+
+Image::Image(size_t width, size_t height, PixelLayout layout, PixelFormat format)
+    : Image(width, height, layout, format, true) {
+}
+
+Image Image::CreateUninitialized(size_t width, size_t height, PixelLayout layout, PixelFormat format) {
+    return Image(width, height, layout, format, false);
+}
+
+Image::Image(size_t width, size_t height, PixelLayout layout, PixelFormat format, bool clear)
+    : Image(width, height, layout, format, nullptr, BufferDeleter{0, nullptr}) {
+    const size_t size = BufferSize();
+    data_ = std::unique_ptr<uint8_t[], BufferDeleter>(BufferPool::GetInstance().Acquire(size),
+                                                      BufferDeleter{size, nullptr});
+    if (clear) {
+        std::memset(data_.get(), 0, size);
+    }
+    origin_ = data_.get();
+}
+
+Image::Image(size_t width, size_t height, PixelLayout layout, PixelFormat format, uint8_t* data,
+             BufferDeleter deleter)
+    : width_(width),
+      height_(height),
+      layout_(layout),
+      format_(format),
+      row_bytes_(GetRowBytes(width, layout, format)),
+      plane_bytes_(row_bytes_ * height),
+      channel_bytes_(layout == PixelLayout::Mono ? 0 : plane_bytes_),
+      data_(data, deleter),
+      origin_(data) {
     if (width == 0 || height == 0) {
         throw std::invalid_argument("Image dimensions cannot be zero");
     }
+    if (format != PixelFormat::Float32 && layout == PixelLayout::Interleaved) {
+        throw std::invalid_argument("Integer pixel formats must be planar");
+    }
+}
+
+Image Image::Adopt(size_t width, size_t height, PixelFormat format, uint8_t* data, size_t bytes,
+                   BufferRelease release) {
+    Image image(width, height, PixelLayout::Planar, format, data, BufferDeleter{bytes, release});
+    if (bytes < image.BufferSize()) {
+        throw std::invalid_argument("Adopted buffer is too small for the image");
+    }
+    return image;
 }
 
 Image::Image(size_t width, size_t height, const std::vector<std::vector<Pixel>>& data) : Image(width, height) {
@@ -13,22 +116,184 @@ Image::Image(size_t width, size_t height, const std::vector<std::vector<Pixel>>&
     }
 
     for (size_t y = 0; y < height; ++y) {
-        for (size_t x = 0; x < width; ++x) {
-            data_[y * width_ + x] = data[y][x];
+        std::copy(data[y].begin(), data[y].end(), Row(y));
+    }
+}
+
+Image::Image(const Image& other) : Image(other.width_, other.height_, other.layout_, other.format_, false) {
+    const size_t planes = layout_ == PixelLayout::Planar ? KChannels : 1;
+    for (size_t c = 0; c < planes; ++c) {
+        for (size_t y = 0; y < height_; ++y) {
+            std::memcpy(ChannelRow<uint8_t>(c, y), other.ChannelRow<uint8_t>(c, y), RowBytes());
         }
     }
 }
 
+Image& Image::operator=(const Image& other) {
+    if (this != &other) {
+        Image copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+size_t Image::GetElementSize(PixelFormat format) {
+    switch (format) {
+        case PixelFormat::UInt8:
+            return sizeof(uint8_t);
+        case PixelFormat::UInt16:
+            return sizeof(uint16_t);
+        case PixelFormat::Float32:
+            break;
+    }
+    return sizeof(float);
+}
+
+size_t Image::GetRowBytes(size_t width, PixelLayout layout, PixelFormat format) {
+    return AlignedRowBytes((layout == PixelLayout::Interleaved ? width * KChannels : width) * GetElementSize(format));
+}
+
+void Image::SetLayout(PixelLayout layout) {
+    if (layout == layout_) {
+        return;
+    }
+    if (layout == PixelLayout::Mono) {
+        throw std::logic_error("Images cannot be converted to Mono");
+    }
+    if (layout_ == PixelLayout::Mono) {
+        Image expanded(width_, height_, PixelLayout::Planar, format_, false);
+        for (size_t c = 0; c < KChannels; ++c) {
+            for (size_t y = 0; y < height_; ++y) {
+                std::memcpy(expanded.ChannelRow<uint8_t>(c, y), ChannelRow<uint8_t>(0, y), RowBytes());
+            }
+        }
+        *this = std::move(expanded);
+        SetLayout(layout);
+        return;
+    }
+    if (format_ != PixelFormat::Float32) {
+        throw std::logic_error("Integer pixel formats must be planar");
+    }
+
+    Image converted(width_, height_, layout, PixelFormat::Float32, false);
+    for (size_t y = 0; y < height_; ++y) {
+        if (layout == PixelLayout::Planar) {
+            const Pixel* row = Row(y);
+            float* r = converted.ChannelRow(0, y);
+            float* g = converted.ChannelRow(1, y);
+            float* b = converted.ChannelRow(2, y);
+            for (size_t x = 0; x < width_; ++x) {
+                r[x] = row[x].r;
+                g[x] = row[x].g;
+                b[x] = row[x].b;
+            }
+        } else {
+            const float* r = ChannelRow(0, y);
+            const float* g = ChannelRow(1, y);
+            const float* b = ChannelRow(2, y);
+            Pixel* row = converted.Row(y);
+            for (size_t x = 0; x < width_; ++x) {
+                row[x] = {r[x], g[x], b[x]};
+            }
+        }
+    }
+    *this = std::move(converted);
+}
+
+void Image::SetFormat(PixelFormat format) {
+    if (format == format_) {
+        return;
+    }
+
+    if (layout_ == PixelLayout::Interleaved) {
+        SetLayout(PixelLayout::Planar);
+    }
+    Image converted(width_, height_, layout_, format, false);
+    switch (format_) {
+        case PixelFormat::Float32:
+            ConvertPlanes<float>(*this, converted);
+            break;
+        case PixelFormat::UInt16:
+            ConvertPlanes<uint16_t>(*this, converted);
+            break;
+        case PixelFormat::UInt8:
+            ConvertPlanes<uint8_t>(*this, converted);
+            break;
+    }
+    *this = std::move(converted);
+}
+
+void Image::Crop(size_t x, size_t y, size_t width, size_t height) {
+    if (width == 0 || height == 0) {
+        throw std::invalid_argument("Image dimensions cannot be zero");
+    }
+    if (x + width > width_ || y + height > height_) {
+        throw std::out_of_range("Crop window out of range");
+    }
+    const size_t pixel_bytes = GetElementSize(format_) * (layout_ == PixelLayout::Interleaved ? KChannels : 1);
+    origin_ += y * row_bytes_ + x * pixel_bytes;
+    width_ = width;
+    height_ = height;
+}
+
 Pixel Image::GetPixel(size_t x, size_t y) const {
     if (x >= width_ || y >= height_) {
         throw std::out_of_range("Pixel coordinates out of range");
     }
-    return data_[y * width_ + x];
+    if (layout_ == PixelLayout::Interleaved) {
+        return Row(y)[x];
+    }
+
+    float values[KChannels];
+    for (size_t c = 0; c < KChannels; ++c) {
+        switch (format_) {
+            case PixelFormat::Float32:
+                values[c] = ChannelRow<float>(c, y)[x];
+                break;
+            case PixelFormat::UInt16:
+                values[c] = pixel::FromWord(ChannelRow<uint16_t>(c, y)[x]);
+                break;
+            case PixelFormat::UInt8:
+                values[c] = pixel::FromByte(ChannelRow<uint8_t>(c, y)[x]);
+                break;
+        }
+    }
+    return {values[0], values[1], values[2]};
 }
 
 void Image::SetPixel(size_t x, size_t y, const Pixel& pixel) {
     if (x >= width_ || y >= height_) {
         throw std::out_of_range("Pixel coordinates out of range");
     }
-    data_[y * width_ + x] = pixel;
-}
\ No newline at end of file
+    if (layout_ == PixelLayout::Mono) {
+        SetLayout(PixelLayout::Planar);
+    }
+    if (layout_ == PixelLayout::Interleaved) {
+        Row(y)[x] = pixel;
+        return;
+    }
+
+    const float values[KChannels] = {pixel.r, pixel.g, pixel.b};
+    for (size_t c = 0; c < KChannels; ++c) {
+        switch (format_) {
+            case PixelFormat::Float32:
+                ChannelRow<float>(c, y)[x] = values[c];
+                break;
+            case PixelFormat::UInt16:
+                ChannelRow<uint16_t>(c, y)[x] = pixel::ToWord(values[c]);
+                break;
+            case PixelFormat::UInt8:
+                ChannelRow<uint8_t>(c, y)[x] = pixel::ToByte(values[c]);
+                break;
+        }
+    }
+}
+
+size_t Image::BufferSize() const {
+    return layout_ == PixelLayout::Planar ? KChannels * plane_bytes_ : plane_bytes_;
+}
+
+// Bytes of pixel data in one row of a plane, without the padding.
+size_t Image::RowBytes() const {
+    return width_ * GetElementSize(format_) * (layout_ == PixelLayout::Interleaved ? KChannels : 1);
+}
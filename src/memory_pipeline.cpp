@@ -0,0 +1,44 @@
+#include "memory_pipeline.h"
+#include "arg_parser.h"
+#include "executor.h"
+#include "reader.h"
+#include "writer.h"
+#include <algorithm>
+#include <thread>
+
+MemoryPipeline::MemoryPipeline(const std::vector<std::string>& chain, size_t threads) {
+    // ArgParser wants a whole command line; the paths are never opened.
+    std::vector<std::string> args = {"", "-", "-"};
+    args.insert(args.end(), chain.begin(), chain.end());
+    std::vector<char*> argv;
+    for (std::string& arg : args) {
+        argv.push_back(arg.data());
+    }
+    filters_ = ArgParser(static_cast<int>(argv.size()), argv.data()).GetFilters();
+    format_ = Executor::GetInputFormat(filters_);
+    window_ = Executor::GetInputWindow(filters_);
+    pool_ = std::make_unique<ThreadPool>(threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency()));
+}
+
+MemoryPipeline::~MemoryPipeline() = default;
+
+Image MemoryPipeline::Filter(const uint8_t* data, size_t size) const {
+    Image image = reader::GetBMPMemoryReader(data, size, format_, window_ ? window_->width : SIZE_MAX,
+                                             window_ ? window_->height : SIZE_MAX, pool_.get())
+                      ->GetImage();
+    Executor(*pool_).Run(image, filters_);
+    return image;
+}
+
+std::vector<uint8_t> MemoryPipeline::Run(const uint8_t* data, size_t size) const {
+    const Image image = Filter(data, size);
+    std::vector<uint8_t> output(writer::GetBMPFileSize(image.GetWidth(), image.GetHeight()));
+    writer::GetBMPMemoryWriter(output.data(), output.size(), pool_.get())->Write(image);
+    return output;
+}
+
+size_t MemoryPipeline::Run(const uint8_t* data, size_t size, uint8_t* output, size_t capacity) const {
+    const Image image = Filter(data, size);
+    writer::GetBMPMemoryWriter(output, capacity, pool_.get())->Write(image);
+    return writer::GetBMPFileSize(image.GetWidth(), image.GetHeight());
+}
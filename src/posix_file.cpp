@@ -0,0 +1,91 @@
+#include "posix_file.h"
+#include <atomic>
+#include <cerrno>
+#include <fcntl.h>
+#include <filesystem>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+PosixFile::PosixFile(const std::string& path, int flags, unsigned mode)
+    : path_(path), fd_(open(path.c_str(), flags | O_CLOEXEC, mode)) {
+    if (fd_ < 0) {
+        throw std::runtime_error("Failed to open file: " + path);
+    }
+}
+
+PosixFile::~PosixFile() {
+    close(fd_);
+}
+
+size_t PosixFile::GetSize() const {
+    struct stat info {};
+    if (fstat(fd_, &info) != 0) {
+        throw std::runtime_error("Failed to query file size: " + path_);
+    }
+    return static_cast<size_t>(info.st_size);
+}
+
+void PosixFile::ReadAt(void* data, size_t size, uint64_t offset) const {
+    auto* bytes = static_cast<char*>(data);
+    while (size > 0) {
+        const ssize_t done = pread(fd_, bytes, size, static_cast<off_t>(offset));
+        if (done < 0 && errno == EINTR) {
+            continue;
+        }
+        if (done <= 0) {
+            throw std::runtime_error("Failed to read file: " + path_);
+        }
+        bytes += done;
+        size -= static_cast<size_t>(done);
+        offset += static_cast<uint64_t>(done);
+    }
+}
+
+void PosixFile::WriteAt(const void* data, size_t size, uint64_t offset) const {
+    const auto* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        const ssize_t done = pwrite(fd_, bytes, size, static_cast<off_t>(offset));
+        if (done < 0 && errno == EINTR) {
+            continue;
+        }
+        if (done <= 0) {
+            throw std::runtime_error("Failed to write file: " + path_);
+        }
+        bytes += done;
+        size -= static_cast<size_t>(done);
+        offset += static_cast<uint64_t>(done);
+    }
+}
+
+void PosixFile::Allocate(uint64_t size) const {
+#ifdef __linux__
+    if (posix_fallocate(fd_, 0, static_cast<off_t>(size)) == 0) {
+        return;
+    }
+#endif
+    if (ftruncate(fd_, static_cast<off_t>(size)) != 0) {
+        throw std::runtime_error("Failed to allocate file: " + path_);
+    }
+}
+
+void PosixFile::Truncate(uint64_t size) const {
+    if (ftruncate(fd_, static_cast<off_t>(size)) != 0) {
+        throw std::runtime_error("Failed to truncate file: " + path_);
+    }
+}
+
+bool IsSameFile(const std::string& first, const std::string& second) {
+    struct stat first_info {};
+    struct stat second_info {};
+    return stat(first.c_str(), &first_info) == 0 && stat(second.c_str(), &second_info) == 0 &&
+           first_info.st_dev == second_info.st_dev && first_info.st_ino == second_info.st_ino;
+}
+
+std::string MakeTemporaryPath(const std::string& path) {
+    static std::atomic<size_t> counter{0};
+    const std::filesystem::path target(path);
+    const std::string name = "." + target.stem().string() + ".tmp-" + std::to_string(getpid()) + "-" +
+                             std::to_string(counter++) + target.extension().string();
+    return (target.parent_path() / name).string();
+}
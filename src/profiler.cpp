@@ -0,0 +1,156 @@
+#include "profiler.h"
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <map>
+
+namespace {
+constexpr double KMicrosecondsPerSecond = 1e6;
+constexpr double KMicrosecondsPerMillisecond = 1e3;
+constexpr double KPixelsPerMegapixel = 1e6;
+constexpr double KBytesPerMegabyte = 1024.0 * 1024.0;
+constexpr int KNameColumnWidth = 28;
+constexpr int KNumberColumnWidth = 12;
+
+std::atomic<Profiler*> active_profiler{nullptr};
+std::atomic<size_t> allocated_bytes{0};
+
+double WallMicroseconds() {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+double CpuMicroseconds() {
+    timespec time{};
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+    return static_cast<double>(time.tv_sec) * KMicrosecondsPerSecond + static_cast<double>(time.tv_nsec) / 1e3;
+}
+
+// Stage names come from filter names and file paths, which may need escaping in JSON.
+std::string EscapeJson(const std::string& text) {
+    std::string result;
+    for (const char c : text) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+        }
+        if (static_cast<unsigned char>(c) >= 0x20) {
+            result += c;
+        }
+    }
+    return result;
+}
+}  // namespace
+
+Profiler::Profiler() : start_us_(WallMicroseconds()) {
+}
+
+Profiler* Profiler::GetActive() {
+    return active_profiler.load(std::memory_order_relaxed);
+}
+
+void Profiler::SetActive(Profiler* profiler) {
+    active_profiler.store(profiler);
+}
+
+void Profiler::CountAllocation(size_t bytes) {
+    allocated_bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+size_t Profiler::GetAllocatedBytes() {
+    return allocated_bytes.load(std::memory_order_relaxed);
+}
+
+double Profiler::GetElapsedMicroseconds() const {
+    return WallMicroseconds() - start_us_;
+}
+
+void Profiler::Record(ProfileEvent event) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto thread = std::find(threads_.begin(), threads_.end(), std::this_thread::get_id());
+    event.thread = static_cast<size_t>(thread - threads_.begin());
+    if (thread == threads_.end()) {
+        threads_.push_back(std::this_thread::get_id());
+    }
+    events_.push_back(std::move(event));
+}
+
+void Profiler::PrintTable(std::ostream& out) const {
+    struct Totals {
+        size_t count = 0;
+        double wall_us = 0.0;
+        double cpu_us = 0.0;
+        size_t pixels = 0;
+        size_t bytes = 0;
+    };
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::string> order;
+    std::map<std::string, Totals> totals;
+    for (const ProfileEvent& event : events_) {
+        if (totals.find(event.name) == totals.end()) {
+            order.push_back(event.name);
+        }
+        Totals& stage = totals[event.name];
+        ++stage.count;
+        stage.wall_us += event.wall_us;
+        stage.cpu_us += event.cpu_us;
+        stage.pixels += event.pixels;
+        stage.bytes += event.bytes_allocated;
+    }
+
+    const std::ios::fmtflags flags = out.flags();
+    const std::streamsize precision = out.precision();
+    out << std::left << std::setw(KNameColumnWidth) << "stage" << std::right << std::setw(KNumberColumnWidth)
+        << "calls" << std::setw(KNumberColumnWidth) << "wall ms" << std::setw(KNumberColumnWidth) << "cpu ms"
+        << std::setw(KNumberColumnWidth) << "MP" << std::setw(KNumberColumnWidth) << "MP/s"
+        << std::setw(KNumberColumnWidth) << "alloc MB" << "\n";
+    out << std::fixed << std::setprecision(2);
+    for (const std::string& name : order) {
+        const Totals& stage = totals[name];
+        const double megapixels = static_cast<double>(stage.pixels) / KPixelsPerMegapixel;
+        const double seconds = stage.wall_us / KMicrosecondsPerSecond;
+        out << std::left << std::setw(KNameColumnWidth) << name << std::right << std::setw(KNumberColumnWidth)
+            << stage.count << std::setw(KNumberColumnWidth) << stage.wall_us / KMicrosecondsPerMillisecond
+            << std::setw(KNumberColumnWidth) << stage.cpu_us / KMicrosecondsPerMillisecond
+            << std::setw(KNumberColumnWidth) << megapixels << std::setw(KNumberColumnWidth)
+            << (seconds > 0.0 ? megapixels / seconds : 0.0) << std::setw(KNumberColumnWidth)
+            << static_cast<double>(stage.bytes) / KBytesPerMegabyte << "\n";
+    }
+    out.flags(flags);
+    out.precision(precision);
+}
+
+void Profiler::WriteChromeTrace(std::ostream& out) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    out << "{\"traceEvents\": [\n";
+    for (size_t i = 0; i < events_.size(); ++i) {
+        const ProfileEvent& event = events_[i];
+        out << "  {\"name\": \"" << EscapeJson(event.name) << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": "
+            << event.thread << ", \"ts\": " << event.start_us << ", \"dur\": " << event.wall_us
+            << ", \"args\": {\"cpu_us\": " << event.cpu_us << ", \"pixels\": " << event.pixels
+            << ", \"bytes_allocated\": " << event.bytes_allocated << "}}" << (i + 1 < events_.size() ? "," : "")
+            << "\n";
+    }
+    out << "], \"displayTimeUnit\": \"ms\"}\n";
+}
+
+ProfileScope::ProfileScope(const char* name, size_t pixels) : profiler_(Profiler::GetActive()), pixels_(pixels) {
+    if (profiler_ == nullptr) {
+        return;
+    }
+    if (name != nullptr) {
+        name_ = name;
+    }
+    start_us_ = profiler_->GetElapsedMicroseconds();
+    start_cpu_us_ = CpuMicroseconds();
+    start_bytes_ = Profiler::GetAllocatedBytes();
+}
+
+ProfileScope::~ProfileScope() {
+    if (profiler_ == nullptr) {
+        return;
+    }
+    profiler_->Record({std::move(name_), start_us_, profiler_->GetElapsedMicroseconds() - start_us_,
+                       CpuMicroseconds() - start_cpu_us_, pixels_, Profiler::GetAllocatedBytes() - start_bytes_, 0});
+}
@@ -1,17 +1,71 @@
 #include "reader.h"
 #include "image.h"
-#include <fstream>
+#include "mapped_file.h"
+#include "posix_file.h"
+#include "thread_pool.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <utility>
 #include <vector>
 #include <stdexcept>
 #include <cstdint>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 namespace {
-constexpr int KBmpBitsPerPixel = 24;
-constexpr int KBmpCompressionNone = 0;
-constexpr float KColorNormalizationFactor = 255.0f;
-constexpr int KBytesPerPixel = 3;
+constexpr uint32_t KBmpCompressionNone = 0;
+constexpr uint32_t KBmpCompressionRle8 = 1;
+constexpr uint32_t KBmpCompressionBitFields = 3;
+constexpr uint16_t KBmpBitsPerPixel8 = 8;
+constexpr uint16_t KBmpBitsPerPixel24 = 24;
+constexpr uint16_t KBmpBitsPerPixel32 = 32;
 constexpr int KPaddingAlignment = 4;
 constexpr uint16_t KBmpSignature = 0x4D42;  // 'BM'
+constexpr size_t KFileHeaderSize = 14;
+constexpr size_t KBgrBytes = 3;
+constexpr size_t KBgraBytes = 4;
+constexpr size_t KPaletteEntryBytes = 4;
+// The only channel masks accepted for 32-bit BI_BITFIELDS files: plain BGRA byte order.
+constexpr uint32_t KRedMask = 0x00FF0000;
+constexpr uint32_t KGreenMask = 0x0000FF00;
+constexpr uint32_t KBlueMask = 0x000000FF;
+// Escape codes following a zero count in an RLE8 stream; larger values start a literal run.
+constexpr uint8_t KRleEndOfLine = 0;
+constexpr uint8_t KRleEndOfBitmap = 1;
+constexpr uint8_t KRleDelta = 2;
+constexpr size_t KByteValues = 256;
+// End-of-bitmap and delta escapes let a few bytes of RLE8 stand for any number of pixels, so
+// the file size does not bound the image; larger RLE8 images are refused before anything is
+// allocated for them.
+constexpr uint64_t KMaxRlePixels = uint64_t{1} << 28;
+// Standard input is read in pieces of at least this size.
+constexpr size_t KConsoleReadBytes = size_t{1} << 20;
+// Whole images are decoded on a pool in bands of about this many file bytes; smaller images
+// are decoded by the calling thread alone.
+constexpr size_t KDecodeBandBytes = size_t{1} << 20;
+// Maps 0-255 onto 0-65535 exactly: 255 * 257 = 65535.
+constexpr unsigned KByteToWord = 257;
+
+// Byte value to normalized channel value, the same numbers as pixel::FromByte.
+const std::array<float, KByteValues>& ByteToFloat() {
+    static const std::array<float, KByteValues> table = [] {
+        std::array<float, KByteValues> values{};
+        for (size_t i = 0; i < KByteValues; ++i) {
+            values[i] = pixel::FromByte(static_cast<uint8_t>(i));
+        }
+        return values;
+    }();
+    return table;
+}
 }  // namespace
 
 #pragma pack(push, 1)
@@ -35,85 +89,556 @@ struct BmpHeader {
 };
 #pragma pack(pop)
 
-namespace reader {
+namespace {
+// Palette entries as stored in the file: blue, green, red, reserved.
+using BmpPalette = std::array<std::array<uint8_t, KPaletteEntryBytes>, KByteValues>;
 
-class BMPReader : public IReader {
-public:
-    explicit BMPReader(const std::string& path) {
-        std::ifstream file(path, std::ios::binary);
-        if (!file.is_open()) {
-            throw std::runtime_error("Failed to open file: " + path);
+// Pixel data placement described by a validated header.
+struct BmpLayout {
+    size_t width;
+    size_t height;
+    size_t row_size;
+    size_t offset;
+    // Bytes of pixel data from offset on; the whole stream for RLE8 files.
+    size_t data_size;
+    bool is_top_down;
+    uint16_t bits_per_pixel;
+    uint32_t compression;
+    // Only filled in for 8-bit files; indices past the stored colors map to black.
+    BmpPalette palette;
+
+    // Offset of the file row holding image row y (counted from the top).
+    size_t RowOffset(size_t y) const {
+        return offset + (is_top_down ? y : height - 1 - y) * row_size;
+    }
+};
+
+// read_at(buffer, size, offset) reads from the file; file_size has been checked to cover the header.
+template <typename ReadAt>
+BmpLayout ParseHeader(ReadAt read_at, size_t file_size) {
+    BmpHeader header;
+    read_at(&header, sizeof(header), 0);
+
+    if (header.type != KBmpSignature) {
+        throw std::runtime_error("Not a valid BMP file (invalid signature)");
+    }
+
+    const bool is_rgb = header.compression == KBmpCompressionNone;
+    const bool is_supported =
+        (header.bpp == KBmpBitsPerPixel24 && is_rgb) ||
+        (header.bpp == KBmpBitsPerPixel32 && (is_rgb || header.compression == KBmpCompressionBitFields)) ||
+        (header.bpp == KBmpBitsPerPixel8 && (is_rgb || header.compression == KBmpCompressionRle8));
+    if (!is_supported) {
+        throw std::runtime_error("Unsupported BMP format: " + std::to_string(header.bpp) +
+                                 " bits per pixel, compression " + std::to_string(header.compression));
+    }
+
+    if (header.offset > file_size) {
+        throw std::runtime_error("Invalid BMP data offset");
+    }
+
+    BmpLayout layout;
+    layout.width = static_cast<size_t>(std::abs(header.width));
+    layout.height = static_cast<size_t>(std::abs(header.height));
+    layout.is_top_down = header.height < 0;
+    layout.bits_per_pixel = header.bpp;
+    layout.compression = header.compression;
+    layout.row_size = (layout.width * header.bpp / CHAR_BIT + KPaddingAlignment - 1) & ~(KPaddingAlignment - 1);
+    layout.offset = header.offset;
+    layout.data_size = file_size - header.offset;
+    layout.palette = {};
+
+    if (header.compression == KBmpCompressionBitFields) {
+        // The masks directly follow a 40-byte info header, and are its next fields in the larger versions.
+        uint32_t masks[3];
+        if (sizeof(header) + sizeof(masks) > header.offset) {
+            throw std::runtime_error("BMP file is truncated");
         }
+        read_at(masks, sizeof(masks), sizeof(header));
+        if (masks[0] != KRedMask || masks[1] != KGreenMask || masks[2] != KBlueMask) {
+            throw std::runtime_error("Only BGRA channel masks are supported for 32-bit BMP files");
+        }
+    }
 
-        file.seekg(0, std::ios::end);
-        const size_t file_size = static_cast<size_t>(file.tellg());
-        file.seekg(0, std::ios::beg);
+    if (header.bpp == KBmpBitsPerPixel8) {
+        const size_t colors = header.colors_used == 0 ? KByteValues : header.colors_used;
+        const size_t palette_offset = KFileHeaderSize + header.info_size;
+        if (colors > KByteValues || palette_offset + colors * KPaletteEntryBytes > header.offset) {
+            throw std::runtime_error("Invalid BMP color table");
+        }
+        read_at(layout.palette.data(), colors * KPaletteEntryBytes, palette_offset);
+    }
 
-        if (file_size < sizeof(BmpHeader)) {
-            throw std::runtime_error("File is too small to be a valid BMP");
+    if (header.compression == KBmpCompressionRle8) {
+        // Compressed rows have no fixed size and are always stored bottom-up.
+        if (layout.is_top_down) {
+            throw std::runtime_error("RLE-compressed BMP files cannot be top-down");
         }
+        if (static_cast<uint64_t>(layout.width) * layout.height > KMaxRlePixels) {
+            throw std::runtime_error("RLE-compressed BMP is too large: " + std::to_string(layout.width) + "x" +
+                                     std::to_string(layout.height));
+        }
+        return layout;
+    }
+
+    const size_t required_size = header.offset + layout.height * layout.row_size;
+    if (file_size < required_size) {
+        throw std::runtime_error("BMP file is truncated");
+    }
+    return layout;
+}
+
+// Splits interleaved BGR or BGRA bytes into the planes of row y.
+template <size_t Stride, typename T, typename Convert>
+void DecodeInterleavedRow(const uint8_t* row, size_t width, T* r, T* g, T* b, Convert convert) {
+    for (size_t x = 0; x < width; ++x) {
+        const uint8_t* pixel = row + x * Stride;
+        b[x] = convert(pixel[0]);
+        g[x] = convert(pixel[1]);
+        r[x] = convert(pixel[2]);
+    }
+}
+
+#ifdef __SSE2__
+constexpr size_t KBgraBlockPixels = 16;
+
+// Stores sixteen channel values, held as four vectors of 32-bit lanes.
+void StoreLanes(const __m128i (&lanes)[4], float* out) {
+    const __m128 scale = _mm_set1_ps(pixel::KByteMax);
+    for (size_t i = 0; i < 4; ++i) {
+        // Exact division, so the values match pixel::FromByte.
+        _mm_storeu_ps(out + 4 * i, _mm_div_ps(_mm_cvtepi32_ps(lanes[i]), scale));
+    }
+}
+
+void StoreLanes(const __m128i (&lanes)[4], uint16_t* out) {
+    for (size_t i = 0; i < 2; ++i) {
+        const __m128i words = _mm_packs_epi32(lanes[2 * i], lanes[2 * i + 1]);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 8 * i), _mm_or_si128(_mm_slli_epi16(words, 8), words));
+    }
+}
 
-        BmpHeader header;
-        if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))) {
-            throw std::runtime_error("Failed to read BMP header");
+void StoreLanes(const __m128i (&lanes)[4], uint8_t* out) {
+    const __m128i low = _mm_packs_epi32(lanes[0], lanes[1]);
+    const __m128i high = _mm_packs_epi32(lanes[2], lanes[3]);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(low, high));
+}
+
+// Splits whole blocks of BGRA pixels with SSE2, which every x86-64 CPU has, and returns the
+// number of pixels done.
+template <typename T>
+size_t SplitBgraBlocks(const uint8_t* row, size_t width, T* r, T* g, T* b) {
+    const __m128i byte_mask = _mm_set1_epi32(0xFF);
+    size_t x = 0;
+    for (; x + KBgraBlockPixels <= width; x += KBgraBlockPixels) {
+        __m128i red[4];
+        __m128i green[4];
+        __m128i blue[4];
+        for (size_t i = 0; i < 4; ++i) {
+            const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + (x + 4 * i) * KBgraBytes));
+            blue[i] = _mm_and_si128(pixels, byte_mask);
+            green[i] = _mm_and_si128(_mm_srli_epi32(pixels, 8), byte_mask);
+            red[i] = _mm_and_si128(_mm_srli_epi32(pixels, 16), byte_mask);
         }
+        StoreLanes(red, r + x);
+        StoreLanes(green, g + x);
+        StoreLanes(blue, b + x);
+    }
+    return x;
+}
+#endif
 
-        if (header.type != KBmpSignature) {
-            throw std::runtime_error("Not a valid BMP file (invalid signature)");
+template <typename T, typename Convert>
+void DecodeBgraRow(const uint8_t* row, size_t width, T* r, T* g, T* b, Convert convert) {
+    size_t done = 0;
+#ifdef __SSE2__
+    done = SplitBgraBlocks(row, width, r, g, b);
+#endif
+    DecodeInterleavedRow<KBgraBytes>(row + done * KBgraBytes, width - done, r + done, g + done, b + done, convert);
+}
+
+// Palette index to channel values, expanded once into the image format.
+template <typename T>
+using PaletteTable = std::array<std::array<T, KByteValues>, Image::KChannels>;
+
+template <typename T, typename Convert>
+PaletteTable<T> ExpandPalette(const BmpPalette& palette, Convert convert) {
+    PaletteTable<T> table;
+    for (size_t i = 0; i < KByteValues; ++i) {
+        table[0][i] = convert(palette[i][2]);
+        table[1][i] = convert(palette[i][1]);
+        table[2][i] = convert(palette[i][0]);
+    }
+    return table;
+}
+
+template <typename T>
+void DecodeIndexedRow(const uint8_t* row, size_t width, const PaletteTable<T>& table, T* r, T* g, T* b) {
+    for (size_t x = 0; x < width; ++x) {
+        const uint8_t index = row[x];
+        r[x] = table[0][index];
+        g[x] = table[1][index];
+        b[x] = table[2][index];
+    }
+}
+
+// Decodes file rows of any supported variant into rows of a planar image of any format. For
+// 8-bit files, including RLE8 once expanded, a row holds one palette index per pixel.
+class RowDecoder {
+public:
+    RowDecoder(const BmpLayout& layout, PixelFormat format)
+        : bits_per_pixel_(layout.bits_per_pixel), format_(format) {
+        if (bits_per_pixel_ != KBmpBitsPerPixel8) {
+            return;
         }
+        switch (format_) {
+            case PixelFormat::UInt8:
+                byte_palette_ = ExpandPalette<uint8_t>(layout.palette, ToByte);
+                break;
+            case PixelFormat::UInt16:
+                word_palette_ = ExpandPalette<uint16_t>(layout.palette, ToWord);
+                break;
+            case PixelFormat::Float32:
+                float_palette_ = ExpandPalette<float>(layout.palette, ToFloat);
+                break;
+        }
+    }
 
-        if (header.bpp != KBmpBitsPerPixel || header.compression != KBmpCompressionNone) {
-            throw std::runtime_error("Only 24-bit uncompressed BMP files are supported");
+    PixelFormat GetFormat() const {
+        return format_;
+    }
+
+    void Decode(const uint8_t* row, size_t width, Image& image, size_t y) const {
+        switch (format_) {
+            case PixelFormat::UInt8:
+                Decode<uint8_t>(row, width, image, y, byte_palette_, ToByte);
+                break;
+            case PixelFormat::UInt16:
+                Decode<uint16_t>(row, width, image, y, word_palette_, ToWord);
+                break;
+            case PixelFormat::Float32: {
+                const std::array<float, KByteValues>& to_float = ByteToFloat();
+                Decode<float>(row, width, image, y, float_palette_,
+                              [&to_float](uint8_t value) { return to_float[value]; });
+                break;
+            }
         }
+    }
+
+private:
+    static uint8_t ToByte(uint8_t value) {
+        return value;
+    }
+    static uint16_t ToWord(uint8_t value) {
+        return static_cast<uint16_t>(value * KByteToWord);
+    }
+    static float ToFloat(uint8_t value) {
+        return ByteToFloat()[value];
+    }
 
-        if (header.offset > file_size) {
-            throw std::runtime_error("Invalid BMP data offset");
+    template <typename T, typename Convert>
+    void Decode(const uint8_t* row, size_t width, Image& image, size_t y, const PaletteTable<T>& palette,
+                Convert convert) const {
+        T* r = image.ChannelRow<T>(0, y);
+        T* g = image.ChannelRow<T>(1, y);
+        T* b = image.ChannelRow<T>(2, y);
+        switch (bits_per_pixel_) {
+            case KBmpBitsPerPixel8:
+                DecodeIndexedRow(row, width, palette, r, g, b);
+                break;
+            case KBmpBitsPerPixel32:
+                DecodeBgraRow(row, width, r, g, b, convert);
+                break;
+            default:
+                DecodeInterleavedRow<KBgrBytes>(row, width, r, g, b, convert);
+                break;
         }
+    }
 
-        width_ = static_cast<size_t>(std::abs(header.width));
-        height_ = static_cast<size_t>(std::abs(header.height));
-        const bool is_top_down = header.height < 0;
+    uint16_t bits_per_pixel_;
+    PixelFormat format_;
+    PaletteTable<uint8_t> byte_palette_;
+    PaletteTable<uint16_t> word_palette_;
+    PaletteTable<float> float_palette_;
+};
 
-        const size_t row_size = (width_ * KBytesPerPixel + KPaddingAlignment - 1) & ~(KPaddingAlignment - 1);
-        const size_t required_size = header.offset + height_ * row_size;
-        if (file_size < required_size) {
-            throw std::runtime_error("BMP file is truncated");
+// Expands an RLE8 stream one row at a time, bottom row first, calling emit(file_row, indices)
+// for every file row. Pixels the stream skips over keep palette index 0.
+template <typename Emit>
+void DecodeRle8(const uint8_t* data, size_t size, size_t width, size_t height, Emit emit) {
+    std::vector<uint8_t> indices(width, 0);
+    size_t pos = 0;
+    size_t row = 0;
+    size_t x = 0;
+
+    const auto next = [&] {
+        if (pos >= size) {
+            throw std::runtime_error("BMP RLE data is truncated");
         }
+        return data[pos++];
+    };
+    const auto finish_row = [&] {
+        emit(row, indices.data());
+        std::fill(indices.begin(), indices.end(), 0);
+        ++row;
+        x = 0;
+    };
 
-        file.seekg(static_cast<std::streamoff>(header.offset), std::ios::beg);
-        data_.resize(height_);
-        std::vector<uint8_t> row(row_size);
+    while (row < height) {
+        const uint8_t count = next();
+        const uint8_t value = next();
+        if (count > 0) {
+            // Runs that overflow the row are clipped.
+            const size_t end = std::min(width, x + count);
+            std::fill(indices.begin() + x, indices.begin() + end, value);
+            x = end;
+        } else if (value == KRleEndOfLine) {
+            finish_row();
+        } else if (value == KRleEndOfBitmap) {
+            break;
+        } else if (value == KRleDelta) {
+            const size_t dx = next();
+            const size_t dy = next();
+            const size_t column = x;
+            for (size_t i = 0; i < dy && row < height; ++i) {
+                finish_row();
+            }
+            x = std::min(width, column + dx);
+        } else {
+            // A literal run is padded to a 16-bit boundary.
+            const size_t length = value;
+            if (pos + length > size) {
+                throw std::runtime_error("BMP RLE data is truncated");
+            }
+            const size_t end = std::min(width, x + length);
+            std::copy(data + pos, data + pos + (end - x), indices.begin() + x);
+            x = end;
+            pos += length + (length & 1);
+        }
+    }
+    while (row < height) {
+        finish_row();
+    }
+}
+
+// Calls decode_band(y, count) for bands of rows [0, height) covering about KDecodeBandBytes of
+// the file each, spread over the pool when there is more than one band and thread to use.
+template <typename DecodeBand>
+void ForEachBand(size_t height, size_t row_size, ThreadPool* pool, DecodeBand decode_band) {
+    const size_t band_rows = std::max<size_t>(1, KDecodeBandBytes / row_size);
+    if (pool == nullptr || pool->GetThreadCount() == 1 || height <= band_rows) {
+        decode_band(0, height);
+        return;
+    }
+    pool->ParallelFor((height + band_rows - 1) / band_rows, [&](size_t band) {
+        const size_t y = band * band_rows;
+        decode_band(y, std::min(band_rows, height - y));
+    });
+}
+}  // namespace
+
+namespace reader {
 
-        for (size_t y = 0; y < height_; ++y) {
-            if (!file.read(reinterpret_cast<char*>(row.data()), static_cast<std::streamsize>(row_size))) {
-                throw std::runtime_error("Failed to read BMP row data");
+// Decodes straight from a memory mapping of the file, or from the caller's bytes, into a planar
+// Image. Given a pool, bands of rows are decoded in parallel; uncompressed files are then read
+// with one positional read per band instead of being mapped, so every thread only faults in its
+// own buffer.
+class BMPReader : public IReader {
+public:
+    BMPReader(const std::string& path, PixelFormat format, size_t max_width, size_t max_height, ThreadPool* pool) {
+        if (pool != nullptr && pool->GetThreadCount() > 1) {
+            const PosixFile file(path, O_RDONLY);
+            const size_t file_size = file.GetSize();
+            if (file_size < sizeof(BmpHeader)) {
+                throw std::runtime_error("File is too small to be a valid BMP");
             }
+            const BmpLayout layout = ParseHeader(
+                [&file](void* buffer, size_t length, size_t offset) { file.ReadAt(buffer, length, offset); },
+                file_size);
+            if (layout.compression != KBmpCompressionRle8) {
+                Read(file, layout, format, max_width, max_height, pool);
+                return;
+            }
+        }
+        const MappedFile file(path);
+        Decode(file.GetData(), file.GetSize(), format, max_width, max_height, pool);
+    }
+
+    BMPReader(const uint8_t* data, size_t size, PixelFormat format, size_t max_width, size_t max_height,
+              ThreadPool* pool) {
+        Decode(data, size, format, max_width, max_height, pool);
+    }
 
-            const size_t target_y = is_top_down ? y : height_ - 1 - y;
-            data_[target_y].resize(width_);
+    Image GetImage() override {
+        if (!image_) {
+            throw std::logic_error("The image has already been taken from the reader");
+        }
+        Image image = std::move(*image_);
+        image_.reset();
+        return image;
+    }
 
-            for (size_t x = 0; x < width_; ++x) {
-                const size_t offset = x * KBytesPerPixel;
-                data_[target_y][x] = {
-                    static_cast<float>(row[offset + 2]) / KColorNormalizationFactor,  // R
-                    static_cast<float>(row[offset + 1]) / KColorNormalizationFactor,  // G
-                    static_cast<float>(row[offset + 0]) / KColorNormalizationFactor   // B
-                };
+private:
+    void Read(const PosixFile& file, const BmpLayout& layout, PixelFormat format, size_t max_width,
+              size_t max_height, ThreadPool* pool) {
+        const RowDecoder decoder(layout, format);
+        const size_t width = std::min(layout.width, max_width);
+        const size_t height = std::min(layout.height, max_height);
+        Image image = Image::CreateUninitialized(width, height, PixelLayout::Planar, format);
+        ForEachBand(height, layout.row_size, pool, [&](size_t y, size_t count) {
+            // The band is contiguous in the file, in reverse order for bottom-up files.
+            thread_local std::vector<uint8_t> buffer;
+            const size_t first_file_row = layout.is_top_down ? y : layout.height - y - count;
+            buffer.resize(count * layout.row_size);
+            file.ReadAt(buffer.data(), buffer.size(), layout.offset + first_file_row * layout.row_size);
+            for (size_t i = 0; i < count; ++i) {
+                const size_t file_row = layout.is_top_down ? i : count - 1 - i;
+                decoder.Decode(buffer.data() + file_row * layout.row_size, width, image, y + i);
             }
+        });
+        image_ = std::move(image);
+    }
+
+    void Decode(const uint8_t* data, size_t size, PixelFormat format, size_t max_width, size_t max_height,
+                ThreadPool* pool) {
+        if (size < sizeof(BmpHeader)) {
+            throw std::runtime_error("File is too small to be a valid BMP");
+        }
+
+        const BmpLayout layout = ParseHeader(
+            [data](void* buffer, size_t length, size_t offset) { std::memcpy(buffer, data + offset, length); },
+            size);
+        const RowDecoder decoder(layout, format);
+
+        // Rows and columns outside the window are never touched, so their pages are never read.
+        const size_t width = std::min(layout.width, max_width);
+        const size_t height = std::min(layout.height, max_height);
+        Image image = Image::CreateUninitialized(width, height, PixelLayout::Planar, format);
+        if (layout.compression == KBmpCompressionRle8) {
+            // The stream has to be walked from its start, but rows outside the window are not expanded.
+            DecodeRle8(data + layout.offset, layout.data_size, layout.width, layout.height,
+                       [&](size_t file_row, const uint8_t* indices) {
+                           const size_t y = layout.height - 1 - file_row;
+                           if (y < height) {
+                               decoder.Decode(indices, width, image, y);
+                           }
+                       });
+        } else {
+            ForEachBand(height, layout.row_size, pool, [&](size_t y, size_t count) {
+                for (size_t i = y; i < y + count; ++i) {
+                    decoder.Decode(data + layout.RowOffset(i), width, image, i);
+                }
+            });
         }
+        image_ = std::move(image);
     }
 
-    Image GetImage() const override {
-        return Image(width_, height_, data_);
+    std::optional<Image> image_;
+};
+
+// Reads bands of rows with positional reads, so only the requested rows are ever in memory.
+// RLE8 rows cannot be located without decoding everything before them, so those files are
+// expanded once into a plane of palette indices, a third of the size of the decoded pixels.
+class BMPRowReader : public IRowReader {
+public:
+    explicit BMPRowReader(const std::string& path) : file_(path, O_RDONLY) {
+        const size_t file_size = file_.GetSize();
+        if (file_size < sizeof(BmpHeader)) {
+            throw std::runtime_error("File is too small to be a valid BMP");
+        }
+
+        layout_ = ParseHeader(
+            [this](void* buffer, size_t size, size_t offset) { file_.ReadAt(buffer, size, offset); }, file_size);
+
+        if (layout_.compression == KBmpCompressionRle8) {
+            std::vector<uint8_t> stream(layout_.data_size);
+            file_.ReadAt(stream.data(), stream.size(), layout_.offset);
+            indices_.resize(layout_.width * layout_.height);
+            DecodeRle8(stream.data(), stream.size(), layout_.width, layout_.height,
+                       [this](size_t file_row, const uint8_t* indices) {
+                           const size_t y = layout_.height - 1 - file_row;
+                           std::copy(indices, indices + layout_.width, indices_.begin() + y * layout_.width);
+                       });
+        }
+    }
+
+    size_t GetWidth() const override {
+        return layout_.width;
+    }
+    size_t GetHeight() const override {
+        return layout_.height;
+    }
+
+    void ReadRows(size_t y, size_t count, Image& dst, size_t dst_y) override {
+        if (count == 0) {
+            return;
+        }
+        if (y + count > layout_.height) {
+            throw std::out_of_range("BMP row range out of range");
+        }
+        if (!decoder_ || decoder_->GetFormat() != dst.GetFormat()) {
+            decoder_.emplace(layout_, dst.GetFormat());
+        }
+
+        if (!indices_.empty()) {
+            for (size_t i = 0; i < count; ++i) {
+                decoder_->Decode(indices_.data() + (y + i) * layout_.width, layout_.width, dst, dst_y + i);
+            }
+            return;
+        }
+
+        // The band is contiguous in the file, in reverse order for bottom-up files.
+        const size_t first_file_row = layout_.is_top_down ? y : layout_.height - y - count;
+        buffer_.resize(count * layout_.row_size);
+        file_.ReadAt(buffer_.data(), buffer_.size(), layout_.offset + first_file_row * layout_.row_size);
+
+        for (size_t i = 0; i < count; ++i) {
+            const size_t file_row = layout_.is_top_down ? i : count - 1 - i;
+            decoder_->Decode(buffer_.data() + file_row * layout_.row_size, layout_.width, dst, dst_y + i);
+        }
     }
 
 private:
-    size_t width_;
-    size_t height_;
-    std::vector<std::vector<Pixel>> data_;
+    PosixFile file_;
+    BmpLayout layout_;
+    std::optional<RowDecoder> decoder_;
+    std::vector<uint8_t> indices_;
+    std::vector<uint8_t> buffer_;
 };
 
-std::shared_ptr<IReader> GetBMPReader(const std::string& path) {
-    return std::make_shared<BMPReader>(path);
+std::shared_ptr<IReader> GetBMPReader(const std::string& path, PixelFormat format, size_t max_width,
+                                      size_t max_height, ThreadPool* pool) {
+    return std::make_shared<BMPReader>(path, format, max_width, max_height, pool);
+}
+
+std::shared_ptr<IRowReader> GetBMPRowReader(const std::string& path) {
+    return std::make_shared<BMPRowReader>(path);
+}
+
+std::shared_ptr<IReader> GetBMPMemoryReader(const uint8_t* data, size_t size, PixelFormat format, size_t max_width,
+                                            size_t max_height, ThreadPool* pool) {
+    return std::make_shared<BMPReader>(data, size, format, max_width, max_height, pool);
+}
+
+// A pipe cannot be mapped or read at offsets, so the input is collected first.
+std::shared_ptr<IReader> GetConsoleReader(PixelFormat format, size_t max_width, size_t max_height,
+                                          ThreadPool* pool) {
+    std::vector<uint8_t> bytes;
+    for (size_t done = 0;;) {
+        bytes.resize(std::max(bytes.size(), done + KConsoleReadBytes));
+        const ssize_t received = read(STDIN_FILENO, bytes.data() + done, bytes.size() - done);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received < 0) {
+            throw std::runtime_error("Failed to read standard input");
+        }
+        if (received == 0) {
+            bytes.resize(done);
+            break;
+        }
+        done += static_cast<size_t>(received);
+    }
+    return GetBMPMemoryReader(bytes.data(), bytes.size(), format, max_width, max_height, pool);
 }
-}  // namespace reader
\ No newline at end of file
+}  // namespace reader
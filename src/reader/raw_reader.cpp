@@ -0,0 +1,176 @@
+#include "reader.h"
+#include "image.h"
+#include "posix_file.h"
+#include "raw_image.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace {
+constexpr uint32_t KLastFormat = static_cast<uint32_t>(PixelFormat::UInt8);
+// The same limit as BMP dimensions, which keeps GetRowBytes() far from wrapping.
+constexpr uint64_t KMaxSide = INT32_MAX;
+
+// a * b, or nullopt if it does not fit in 64 bits.
+std::optional<uint64_t> Multiply(uint64_t a, uint64_t b) {
+    if (a != 0 && b > UINT64_MAX / a) {
+        return std::nullopt;
+    }
+    return a * b;
+}
+
+raw_image::Header ReadHeader(const PosixFile& file, const std::string& path) {
+    raw_image::Header header;
+    if (file.GetSize() < sizeof(header)) {
+        throw std::runtime_error("File is too small to be a raw image: " + path);
+    }
+    file.ReadAt(&header, sizeof(header), 0);
+
+    if (std::memcmp(header.magic, raw_image::KMagic, sizeof(header.magic)) != 0) {
+        throw std::runtime_error("Not a raw image (invalid signature): " + path);
+    }
+    if (header.version != raw_image::KVersion || header.format > KLastFormat) {
+        throw std::runtime_error("Unsupported raw image version or format: " + path);
+    }
+    if (header.width == 0 || header.height == 0) {
+        throw std::runtime_error("Image dimensions cannot be zero");
+    }
+    if (header.width > KMaxSide || header.height > KMaxSide) {
+        throw std::runtime_error("Raw image dimensions are too large: " + path);
+    }
+    const PixelFormat format = static_cast<PixelFormat>(header.format);
+    if (header.row_bytes != Image::GetRowBytes(header.width, PixelLayout::Planar, format) ||
+        header.data_offset % raw_image::KDataOffset != 0) {
+        throw std::runtime_error("Raw image layout does not match this build: " + path);
+    }
+    // Checked before GetPlaneBytes() is trusted anywhere: a wrapped size would map too few bytes.
+    const std::optional<uint64_t> plane_bytes = Multiply(header.row_bytes, header.height);
+    const std::optional<uint64_t> data_bytes =
+        plane_bytes ? Multiply(Image::KChannels, *plane_bytes) : std::nullopt;
+    if (!data_bytes || *data_bytes > UINT64_MAX - header.data_offset || *data_bytes > SIZE_MAX) {
+        throw std::runtime_error("Raw image dimensions are too large: " + path);
+    }
+    if (file.GetSize() < header.data_offset + *data_bytes) {
+        throw std::runtime_error("Raw image is truncated: " + path);
+    }
+    return header;
+}
+}  // namespace
+
+namespace reader {
+
+// Maps the planes of the file copy-on-write and hands them to the Image as its buffer, so pages
+// are only read once a filter touches them.
+class RawReader : public IReader {
+public:
+    RawReader(const std::string& path, PixelFormat format, size_t max_width, size_t max_height) {
+        const PosixFile file(path, O_RDONLY);
+        const raw_image::Header header = ReadHeader(file, path);
+
+        const size_t bytes = Image::KChannels * raw_image::GetPlaneBytes(header);
+        void* mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, file.GetDescriptor(),
+                             static_cast<off_t>(header.data_offset));
+        if (mapping == MAP_FAILED) {
+            throw std::runtime_error("Failed to map file: " + path);
+        }
+
+        Image image = Image::Adopt(header.width, header.height, static_cast<PixelFormat>(header.format),
+                                   static_cast<uint8_t*>(mapping), bytes,
+                                   [](uint8_t* data, size_t size) { munmap(data, size); });
+        image.Crop(0, 0, std::min<size_t>(header.width, max_width), std::min<size_t>(header.height, max_height));
+        // A narrower stored format than requested would round where the chain expects exact values;
+        // a wider one only makes the chain more precise.
+        if (format == PixelFormat::Float32) {
+            image.SetFormat(format);
+        }
+        image_ = std::move(image);
+    }
+
+    Image GetImage() override {
+        if (!image_) {
+            throw std::logic_error("The image has already been taken from the reader");
+        }
+        Image image = std::move(*image_);
+        image_.reset();
+        return image;
+    }
+
+private:
+    std::optional<Image> image_;
+};
+
+// Reads bands of rows of each plane with positional reads.
+class RawRowReader : public IRowReader {
+public:
+    explicit RawRowReader(const std::string& path) : file_(path, O_RDONLY), header_(ReadHeader(file_, path)) {
+    }
+
+    size_t GetWidth() const override {
+        return header_.width;
+    }
+    size_t GetHeight() const override {
+        return header_.height;
+    }
+
+    void ReadRows(size_t y, size_t count, Image& dst, size_t dst_y) override {
+        if (count == 0) {
+            return;
+        }
+        if (y + count > header_.height) {
+            throw std::out_of_range("Raw image row range out of range");
+        }
+
+        Image band = Image::CreateUninitialized(header_.width, count, PixelLayout::Planar,
+                                                static_cast<PixelFormat>(header_.format));
+        for (size_t c = 0; c < Image::KChannels; ++c) {
+            file_.ReadAt(band.ChannelRow<uint8_t>(c, 0), count * header_.row_bytes,
+                         header_.data_offset + c * raw_image::GetPlaneBytes(header_) + y * header_.row_bytes);
+        }
+        band.SetFormat(dst.GetFormat());
+
+        const size_t row_size = header_.width * Image::GetElementSize(dst.GetFormat());
+        for (size_t c = 0; c < Image::KChannels; ++c) {
+            for (size_t i = 0; i < count; ++i) {
+                std::memcpy(dst.ChannelRow<uint8_t>(c, dst_y + i), band.ChannelRow<uint8_t>(c, i), row_size);
+            }
+        }
+    }
+
+private:
+    PosixFile file_;
+    raw_image::Header header_;
+};
+
+std::shared_ptr<IReader> GetRawReader(const std::string& path, PixelFormat format, size_t max_width,
+                                      size_t max_height) {
+    return std::make_shared<RawReader>(path, format, max_width, max_height);
+}
+
+std::shared_ptr<IRowReader> GetRawRowReader(const std::string& path) {
+    return std::make_shared<RawRowReader>(path);
+}
+
+std::shared_ptr<IReader> GetFileReader(const std::string& path, PixelFormat format, size_t max_width,
+                                       size_t max_height, ThreadPool* pool) {
+    if (path == KConsolePath) {
+        return GetConsoleReader(format, max_width, max_height, pool);
+    }
+    if (raw_image::IsRawPath(path)) {
+        return GetRawReader(path, format, max_width, max_height);
+    }
+    return GetBMPReader(path, format, max_width, max_height, pool);
+}
+
+std::shared_ptr<IRowReader> GetFileRowReader(const std::string& path) {
+    if (raw_image::IsRawPath(path)) {
+        return GetRawRowReader(path);
+    }
+    return GetBMPRowReader(path);
+}
+}  // namespace reader
@@ -0,0 +1,318 @@
+#include "result_cache.h"
+#include "mapped_file.h"
+#include "posix_file.h"
+#include "raw_image.h"
+#include "writer.h"
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+namespace fs = std::filesystem;
+
+namespace {
+// Part of every key, so that entries written by builds whose filters compute different results
+// are never found. Bump it whenever the output of a filter changes.
+constexpr char KKeyVersion[] = "image_processor result cache v1";
+constexpr char KCountersFile[] = "counters";
+constexpr char KTemporaryPrefix[] = ".tmp-";
+constexpr char KResultExtension[] = ".bmp";
+constexpr uint64_t KKeySeeds[] = {0, 1};
+
+// XXH64.
+constexpr uint64_t KPrime1 = 11400714785074694791ULL;
+constexpr uint64_t KPrime2 = 14029467366897019727ULL;
+constexpr uint64_t KPrime3 = 1609587929392839161ULL;
+constexpr uint64_t KPrime4 = 9650029242287828579ULL;
+constexpr uint64_t KPrime5 = 2870177450012600261ULL;
+constexpr size_t KStripeBytes = 32;
+
+uint64_t RotateLeft(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+uint64_t Load64(const uint8_t* data) {
+    uint64_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+uint32_t Load32(const uint8_t* data) {
+    uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+uint64_t Round(uint64_t accumulator, uint64_t input) {
+    return RotateLeft(accumulator + input * KPrime2, 31) * KPrime1;
+}
+
+uint64_t Merge(uint64_t hash, uint64_t accumulator) {
+    return (hash ^ Round(0, accumulator)) * KPrime1 + KPrime4;
+}
+
+uint64_t Hash64(const uint8_t* data, size_t size, uint64_t seed) {
+    const uint8_t* const end = data + size;
+    uint64_t hash = 0;
+    if (size >= KStripeBytes) {
+        uint64_t lanes[4] = {seed + KPrime1 + KPrime2, seed + KPrime2, seed, seed - KPrime1};
+        for (; end - data >= static_cast<ptrdiff_t>(KStripeBytes); data += KStripeBytes) {
+            for (size_t i = 0; i < 4; ++i) {
+                lanes[i] = Round(lanes[i], Load64(data + i * sizeof(uint64_t)));
+            }
+        }
+        hash = RotateLeft(lanes[0], 1) + RotateLeft(lanes[1], 7) + RotateLeft(lanes[2], 12) + RotateLeft(lanes[3], 18);
+        for (uint64_t lane : lanes) {
+            hash = Merge(hash, lane);
+        }
+    } else {
+        hash = seed + KPrime5;
+    }
+    hash += size;
+
+    for (; end - data >= 8; data += 8) {
+        hash = RotateLeft(hash ^ Round(0, Load64(data)), 27) * KPrime1 + KPrime4;
+    }
+    if (end - data >= 4) {
+        hash = RotateLeft(hash ^ (Load32(data) * KPrime1), 23) * KPrime2 + KPrime3;
+        data += 4;
+    }
+    for (; data < end; ++data) {
+        hash = RotateLeft(hash ^ (*data * KPrime5), 11) * KPrime1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= KPrime2;
+    hash ^= hash >> 29;
+    hash *= KPrime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+std::string ToHex(uint64_t value) {
+    static const char KDigits[] = "0123456789abcdef";
+    std::string text(16, '0');
+    for (size_t i = text.size(); i-- > 0; value >>= 4) {
+        text[i] = KDigits[value & 0xF];
+    }
+    return text;
+}
+
+// Marks an entry as just used for the eviction order.
+void Touch(const fs::path& path) {
+    std::error_code error;
+    fs::last_write_time(path, fs::file_time_type::clock::now(), error);
+}
+
+ResultCache::Stats ParseCounters(const std::string& text) {
+    ResultCache::Stats stats;
+    std::istringstream in(text);
+    std::string name;
+    size_t value = 0;
+    while (in >> name >> value) {
+        if (name == "hits") {
+            stats.hits = value;
+        } else if (name == "prefix_hits") {
+            stats.prefix_hits = value;
+        } else if (name == "misses") {
+            stats.misses = value;
+        } else if (name == "evictions") {
+            stats.evictions = value;
+        }
+    }
+    return stats;
+}
+
+std::string ReadWhole(const PosixFile& file) {
+    std::string text(file.GetSize(), '\0');
+    file.ReadAt(text.data(), text.size(), 0);
+    return text;
+}
+}  // namespace
+
+ResultCache::ResultCache(std::string directory, uint64_t max_bytes)
+    : directory_(std::move(directory)), max_bytes_(max_bytes) {
+    fs::create_directories(directory_);
+}
+
+ResultCache::~ResultCache() {
+    try {
+        const PosixFile file((fs::path(directory_) / KCountersFile).string(), O_RDWR | O_CREAT);
+        if (flock(file.GetDescriptor(), LOCK_EX) != 0) {
+            return;
+        }
+        Stats totals = ParseCounters(ReadWhole(file));
+        totals.hits += stats_.hits;
+        totals.prefix_hits += stats_.prefix_hits;
+        totals.misses += stats_.misses;
+        totals.evictions += stats_.evictions;
+
+        std::ostringstream out;
+        out << "hits " << totals.hits << "\nprefix_hits " << totals.prefix_hits << "\nmisses " << totals.misses
+            << "\nevictions " << totals.evictions << "\n";
+        const std::string text = out.str();
+        file.Truncate(0);
+        file.WriteAt(text.data(), text.size(), 0);
+    } catch (const std::exception&) {
+        // Losing the counts of one run is better than failing it.
+    }
+}
+
+uint64_t ResultCache::HashFile(const std::string& path) {
+    const MappedFile file(path);
+    return Hash64(file.GetData(), file.GetSize(), 0);
+}
+
+std::string ResultCache::MakeKey(uint64_t input_hash, const std::vector<std::string>& stages, size_t count) {
+    std::string text = std::string(KKeyVersion) + "\n" + ToHex(input_hash) + "\n";
+    for (size_t i = 0; i < count; ++i) {
+        text += stages[i] + "\n";
+    }
+    std::string key;
+    for (uint64_t seed : KKeySeeds) {
+        key += ToHex(Hash64(reinterpret_cast<const uint8_t*>(text.data()), text.size(), seed));
+    }
+    return key;
+}
+
+bool ResultCache::FetchResult(const std::string& key, const std::string& output) {
+    const std::string entry = GetPath(key, raw_image::IsRawPath(output) ? raw_image::KExtension : KResultExtension);
+    std::error_code error;
+    if (!fs::is_regular_file(entry, error)) {
+        return false;
+    }
+    // Another run may evict the entry in the meantime; that is just a miss.
+    if (!fs::copy_file(entry, output, fs::copy_options::overwrite_existing, error)) {
+        return false;
+    }
+    Touch(entry);
+    return true;
+}
+
+std::optional<std::string> ResultCache::FindIntermediate(const std::string& key) {
+    const std::string entry = GetPath(key, raw_image::KExtension);
+    std::error_code error;
+    if (!fs::is_regular_file(entry, error)) {
+        return std::nullopt;
+    }
+    Touch(entry);
+    return entry;
+}
+
+void ResultCache::StoreResult(const std::string& key, const std::string& output) {
+    // The intermediate of a raw output is the very same file.
+    const bool is_raw = raw_image::IsRawPath(output);
+    const std::string entry = GetPath(key, is_raw ? raw_image::KExtension : KResultExtension);
+    std::error_code error;
+    if (is_raw && fs::is_regular_file(entry, error)) {
+        return;
+    }
+    Insert(output, entry);
+    Evict();
+}
+
+void ResultCache::StoreIntermediate(const std::string& key, const Image& image) {
+    const std::string temporary = MakeTemporaryPath();
+    const std::string entry = GetPath(key, raw_image::KExtension);
+    try {
+        writer::GetRawWriter(temporary)->Write(image);
+        fs::rename(temporary, entry);
+        Touch(entry);
+    } catch (...) {
+        std::error_code error;
+        fs::remove(temporary, error);
+        throw;
+    }
+    Evict();
+}
+
+void ResultCache::CountHit() {
+    ++stats_.hits;
+}
+
+void ResultCache::CountPrefixHit() {
+    ++stats_.prefix_hits;
+}
+
+void ResultCache::CountMiss() {
+    ++stats_.misses;
+}
+
+ResultCache::Stats ResultCache::GetTotals() const {
+    Stats totals;
+    try {
+        totals = ParseCounters(ReadWhole(PosixFile((fs::path(directory_) / KCountersFile).string(), O_RDONLY)));
+    } catch (const std::exception&) {
+    }
+    totals.hits += stats_.hits;
+    totals.prefix_hits += stats_.prefix_hits;
+    totals.misses += stats_.misses;
+    totals.evictions += stats_.evictions;
+    return totals;
+}
+
+std::string ResultCache::GetPath(const std::string& key, const std::string& extension) const {
+    return (fs::path(directory_) / (key + extension)).string();
+}
+
+// Unique among the processes and threads sharing the directory; eviction skips these names.
+std::string ResultCache::MakeTemporaryPath() const {
+    static std::atomic<size_t> counter{0};
+    const std::string name = KTemporaryPrefix + std::to_string(getpid()) + "-" + std::to_string(counter++);
+    return (fs::path(directory_) / name).string();
+}
+
+void ResultCache::Insert(const std::string& source, const std::string& entry) {
+    const std::string temporary = MakeTemporaryPath();
+    try {
+        fs::copy_file(source, temporary, fs::copy_options::overwrite_existing);
+        fs::rename(temporary, entry);
+        Touch(entry);
+    } catch (...) {
+        std::error_code error;
+        fs::remove(temporary, error);
+        throw;
+    }
+}
+
+void ResultCache::Evict() {
+    struct Entry {
+        fs::path path;
+        uint64_t size;
+        fs::file_time_type used;
+    };
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+    std::error_code error;
+    for (const fs::directory_entry& item : fs::directory_iterator(directory_, error)) {
+        const std::string name = item.path().filename().string();
+        if (name == KCountersFile || name.rfind(KTemporaryPrefix, 0) == 0 || !item.is_regular_file(error)) {
+            continue;
+        }
+        const uint64_t size = item.file_size(error);
+        const fs::file_time_type used = item.last_write_time(error);
+        if (!error) {
+            entries.push_back({item.path(), size, used});
+            total += size;
+        }
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.used < b.used; });
+    for (const Entry& entry : entries) {
+        if (total <= max_bytes_) {
+            break;
+        }
+        // Only what this call removed comes off the total; whatever failed to go leaves the next
+        // oldest entry to be evicted in its place.
+        if (fs::remove(entry.path, error)) {
+            ++stats_.evictions;
+            total -= entry.size;
+        }
+    }
+}
@@ -0,0 +1,608 @@
+#include "server.h"
+#include "arg_parser.h"
+#include "executor.h"
+#include "raw_image.h"
+#include "reader.h"
+#include "writer.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+namespace {
+constexpr int KListenBacklog = 128;
+// A client that stalls in the middle of a message, or stops reading its answer, loses the
+// connection after this long instead of holding a worker.
+constexpr int KSocketTimeoutSeconds = 10;
+constexpr size_t KMaxArgs = 4096;
+constexpr uint32_t KMaxArgBytes = 1 << 16;
+constexpr uint64_t KMaxInputBytes = uint64_t{4} << 30;
+// Strings are read in pieces of this size, so memory is only committed as the bytes arrive.
+constexpr size_t KReadChunkBytes = size_t{1} << 20;
+constexpr uint32_t KMaxMessageBytes = 1 << 24;
+constexpr size_t KMaxCachedChains = 256;
+// Latencies kept for the percentiles; older ones are overwritten.
+constexpr size_t KLatencySamples = 1 << 16;
+constexpr double KPercentiles[] = {50.0, 90.0, 99.0};
+constexpr double KMicrosecondsPerMillisecond = 1000.0;
+// The listening socket and the two pipes come first in the accept loop's poll set, then the
+// idle connections in order.
+constexpr size_t KWatchedFds = 3;
+
+// The write end of the wake-up pipe of the running server, for the signal handler.
+std::atomic<int> signal_wake_fd{-1};
+
+void OnStopSignal(int) {
+    const int fd = signal_wake_fd.load();
+    if (fd >= 0) {
+        const char byte = 0;
+        [[maybe_unused]] const ssize_t written = write(fd, &byte, 1);
+    }
+}
+
+double NowMicroseconds() {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+std::runtime_error SystemError(const std::string& what) {
+    return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+// Half the memory free now, at most KMaxInputBytes.
+uint64_t GetInputBudget() {
+    const long pages = sysconf(_SC_AVPHYS_PAGES);
+    const long page_size = sysconf(_SC_PAGESIZE);
+    if (pages <= 0 || page_size <= 0) {
+        return KMaxInputBytes;
+    }
+    return std::min(KMaxInputBytes, static_cast<uint64_t>(pages) * static_cast<uint64_t>(page_size) / 2);
+}
+
+// Gives input bytes reserved with Server::ReserveInput back to the budget.
+class InputReservation {
+public:
+    InputReservation(std::atomic<uint64_t>& reserved, uint64_t bytes) : reserved_(reserved), bytes_(bytes) {
+    }
+    ~InputReservation() {
+        reserved_ -= bytes_;
+    }
+
+    InputReservation(const InputReservation&) = delete;
+    InputReservation& operator=(const InputReservation&) = delete;
+
+private:
+    std::atomic<uint64_t>& reserved_;
+    uint64_t bytes_;
+};
+
+// False if the peer closed the connection before the first byte; throws if it did so later.
+bool ReadExactly(int fd, void* data, size_t size) {
+    auto* bytes = static_cast<uint8_t*>(data);
+    for (size_t done = 0; done < size;) {
+        const ssize_t received = recv(fd, bytes + done, size - done, 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received < 0) {
+            throw SystemError("Failed to read from socket");
+        }
+        if (received == 0) {
+            if (done == 0) {
+                return false;
+            }
+            throw std::runtime_error("Connection closed in the middle of a message");
+        }
+        done += static_cast<size_t>(received);
+    }
+    return true;
+}
+
+void WriteAll(int fd, const void* data, size_t size) {
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    for (size_t done = 0; done < size;) {
+        // A client that went away must not kill the server with SIGPIPE.
+        const ssize_t sent = send(fd, bytes + done, size - done, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent < 0) {
+            throw SystemError("Failed to write to socket");
+        }
+        done += static_cast<size_t>(sent);
+    }
+}
+
+template <typename T>
+void Append(std::string& message, T value) {
+    message.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void AppendString(std::string& message, const std::string& text) {
+    Append(message, static_cast<uint32_t>(text.size()));
+    message += text;
+}
+
+template <typename T>
+T ReadValue(int fd) {
+    T value;
+    if (!ReadExactly(fd, &value, sizeof(value))) {
+        throw std::runtime_error("Connection closed in the middle of a message");
+    }
+    return value;
+}
+
+std::string ReadString(int fd, uint64_t size, uint64_t max_size) {
+    if (size > max_size) {
+        throw std::runtime_error("Message field of " + std::to_string(size) + " bytes is too large");
+    }
+    std::string text;
+    while (text.size() < size) {
+        const size_t done = text.size();
+        const size_t chunk = static_cast<size_t>(std::min<uint64_t>(KReadChunkBytes, size - done));
+        text.resize(done + chunk);
+        if (!ReadExactly(fd, text.data() + done, chunk)) {
+            throw std::runtime_error("Connection closed in the middle of a message");
+        }
+    }
+    return text;
+}
+
+// Requests are a type byte, the argument count and the length-prefixed arguments, then the
+// length-prefixed input bytes; integers are in host order, as both ends share the machine.
+void SendRequest(int fd, const ServeRequest& request) {
+    std::string message;
+    Append(message, static_cast<uint8_t>(request.type));
+    Append(message, static_cast<uint32_t>(request.args.size()));
+    for (const std::string& arg : request.args) {
+        AppendString(message, arg);
+    }
+    Append(message, static_cast<uint64_t>(request.input_bytes.size()));
+    WriteAll(fd, message.data(), message.size());
+    WriteAll(fd, request.input_bytes.data(), request.input_bytes.size());
+}
+
+// False when the client closed the connection between requests. Leaves the input bytes, whose
+// length is returned in input_size, unread.
+bool ReceiveRequestHeader(int fd, ServeRequest& request, uint64_t& input_size) {
+    uint8_t type = 0;
+    if (!ReadExactly(fd, &type, sizeof(type))) {
+        return false;
+    }
+    if (type < static_cast<uint8_t>(ServeRequestType::Run) || type > static_cast<uint8_t>(ServeRequestType::Shutdown)) {
+        throw std::runtime_error("Unknown request type " + std::to_string(type));
+    }
+    request.type = static_cast<ServeRequestType>(type);
+    const auto count = ReadValue<uint32_t>(fd);
+    if (count > KMaxArgs) {
+        throw std::runtime_error("Too many arguments in request");
+    }
+    request.args.clear();
+    for (uint32_t i = 0; i < count; ++i) {
+        request.args.push_back(ReadString(fd, ReadValue<uint32_t>(fd), KMaxArgBytes));
+    }
+    input_size = ReadValue<uint64_t>(fd);
+    if (input_size > KMaxInputBytes) {
+        throw std::runtime_error("Message field of " + std::to_string(input_size) + " bytes is too large");
+    }
+    request.input_bytes.clear();
+    return true;
+}
+
+void SendResponse(int fd, const ServeResponse& response) {
+    std::string message;
+    Append(message, static_cast<uint8_t>(response.ok));
+    AppendString(message, response.message);
+    WriteAll(fd, message.data(), message.size());
+}
+
+bool ReceiveResponse(int fd, ServeResponse& response) {
+    uint8_t ok = 0;
+    if (!ReadExactly(fd, &ok, sizeof(ok))) {
+        return false;
+    }
+    response.ok = ok != 0;
+    response.message = ReadString(fd, ReadValue<uint32_t>(fd), KMaxMessageBytes);
+    return true;
+}
+
+sockaddr_un MakeAddress(const std::string& path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Invalid socket path: " + path);
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+
+int ConnectTo(const std::string& path) {
+    const sockaddr_un address = MakeAddress(path);
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        throw SystemError("Failed to create socket");
+    }
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        const std::runtime_error error = SystemError("Failed to connect to " + path);
+        close(fd);
+        throw error;
+    }
+    return fd;
+}
+
+}  // namespace
+
+std::string DescribeLatencies(std::vector<double> latencies_us) {
+    if (latencies_us.empty()) {
+        return "no requests";
+    }
+    std::sort(latencies_us.begin(), latencies_us.end());
+    const auto at = [&](double percentile) {
+        const auto rank = static_cast<size_t>(std::ceil(percentile / 100.0 * static_cast<double>(latencies_us.size())));
+        return latencies_us[std::max<size_t>(rank, 1) - 1] / KMicrosecondsPerMillisecond;
+    };
+    std::string text;
+    char part[64];
+    for (const double percentile : KPercentiles) {
+        std::snprintf(part, sizeof(part), "p%g %.2f ms, ", percentile, at(percentile));
+        text += part;
+    }
+    std::snprintf(part, sizeof(part), "max %.2f ms", latencies_us.back() / KMicrosecondsPerMillisecond);
+    return text + part;
+}
+
+Server::Server(std::string socket_path, ThreadPool& pool, size_t concurrency, size_t queue_capacity)
+    : socket_path_(std::move(socket_path)),
+      pool_(pool),
+      concurrency_(std::max<size_t>(1, concurrency)),
+      queue_capacity_(std::max<size_t>(1, queue_capacity)),
+      input_budget_(GetInputBudget()) {
+    const sockaddr_un address = MakeAddress(socket_path_);
+    struct stat status {};
+    if (lstat(socket_path_.c_str(), &status) == 0) {
+        if (!S_ISSOCK(status.st_mode)) {
+            throw std::runtime_error("Not a socket: " + socket_path_);
+        }
+        // A socket nobody answers on is left over from a server that died; take it over.
+        try {
+            close(ConnectTo(socket_path_));
+        } catch (const std::runtime_error&) {
+            unlink(socket_path_.c_str());
+        }
+        if (access(socket_path_.c_str(), F_OK) == 0) {
+            throw std::runtime_error("Socket is in use: " + socket_path_);
+        }
+    }
+
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) {
+        throw SystemError("Failed to create socket");
+    }
+    if (bind(listen_fd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(listen_fd_, KListenBacklog) != 0) {
+        const std::runtime_error error = SystemError("Failed to listen on " + socket_path_);
+        close(listen_fd_);
+        throw error;
+    }
+    if (pipe2(wake_fds_, O_CLOEXEC) != 0) {
+        const std::runtime_error error = SystemError("Failed to create pipe");
+        close(listen_fd_);
+        unlink(socket_path_.c_str());
+        throw error;
+    }
+    // Non-blocking, so that many hand-backs between two polls can neither fill it nor block.
+    if (pipe2(return_fds_, O_CLOEXEC | O_NONBLOCK) != 0) {
+        const std::runtime_error error = SystemError("Failed to create pipe");
+        close(listen_fd_);
+        close(wake_fds_[0]);
+        close(wake_fds_[1]);
+        unlink(socket_path_.c_str());
+        throw error;
+    }
+}
+
+Server::~Server() {
+    close(listen_fd_);
+    close(wake_fds_[0]);
+    close(wake_fds_[1]);
+    close(return_fds_[0]);
+    close(return_fds_[1]);
+    unlink(socket_path_.c_str());
+}
+
+void Server::Run() {
+    signal_wake_fd = wake_fds_[1];
+    struct sigaction action {};
+    action.sa_handler = OnStopSignal;
+    sigemptyset(&action.sa_mask);
+    struct sigaction previous_int {};
+    struct sigaction previous_term {};
+    sigaction(SIGINT, &action, &previous_int);
+    sigaction(SIGTERM, &action, &previous_term);
+
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < concurrency_; ++i) {
+        workers.emplace_back([this] { ServeConnections(); });
+    }
+
+    // Connections between requests, watched here rather than by a worker.
+    std::vector<int> idle;
+    std::vector<pollfd> fds;
+    while (true) {
+        fds.assign({{listen_fd_, POLLIN, 0}, {wake_fds_[0], POLLIN, 0}, {return_fds_[0], POLLIN, 0}});
+        for (const int fd : idle) {
+            fds.push_back({fd, POLLIN, 0});
+        }
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (fds[1].revents != 0) {
+            break;
+        }
+
+        // A connection with a request or a hang-up waiting was accepted before, so it is queued
+        // even when the queue is full.
+        std::vector<int> still_idle;
+        bool queued = false;
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            for (size_t i = 0; i < idle.size(); ++i) {
+                if (fds[KWatchedFds + i].revents != 0) {
+                    queue_.emplace_back(idle[i], NowMicroseconds());
+                    queued = true;
+                } else {
+                    still_idle.push_back(idle[i]);
+                }
+            }
+            if (fds[2].revents != 0) {
+                char bytes[64];
+                while (read(return_fds_[0], bytes, sizeof(bytes)) > 0) {
+                }
+                still_idle.insert(still_idle.end(), returned_.begin(), returned_.end());
+                returned_.clear();
+            }
+        }
+        if (queued) {
+            queue_cv_.notify_all();
+        }
+        idle = std::move(still_idle);
+        if (fds[0].revents == 0) {
+            continue;
+        }
+
+        const int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+        const timeval timeout{KSocketTimeoutSeconds, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        std::unique_lock<std::mutex> lock(queue_mutex_);
+        if (queue_.size() >= queue_capacity_) {
+            lock.unlock();
+            {
+                std::lock_guard<std::mutex> stats_lock(stats_mutex_);
+                ++rejected_;
+            }
+            try {
+                SendResponse(fd, {false, "Server busy: " + std::to_string(queue_capacity_) + " connections queued"});
+            } catch (const std::exception&) {
+            }
+            close(fd);
+            continue;
+        }
+        queue_.emplace_back(fd, NowMicroseconds());
+        lock.unlock();
+        queue_cv_.notify_one();
+    }
+    for (const int fd : idle) {
+        close(fd);
+    }
+
+    stopping_ = true;
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        queue_closed_ = true;
+    }
+    queue_cv_.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    for (const int fd : returned_) {
+        close(fd);
+    }
+    returned_.clear();
+    signal_wake_fd = -1;
+    sigaction(SIGINT, &previous_int, nullptr);
+    sigaction(SIGTERM, &previous_term, nullptr);
+}
+
+std::string Server::GetStats() const {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    return "Requests: " + std::to_string(requests_) + " (" + std::to_string(failed_) + " failed), " +
+           std::to_string(rejected_) + " connections rejected; latency " + DescribeLatencies(latencies_us_);
+}
+
+void Server::ServeConnections() {
+    while (true) {
+        std::unique_lock<std::mutex> lock(queue_mutex_);
+        queue_cv_.wait(lock, [this] { return queue_closed_ || !queue_.empty(); });
+        if (queue_.empty()) {
+            return;
+        }
+        const auto [fd, queued_us] = queue_.front();
+        queue_.pop_front();
+        lock.unlock();
+
+        bool keep = false;
+        try {
+            keep = ServeNextRequest(fd, queued_us);
+        } catch (const std::exception&) {
+            // The connection is broken; its client sees it closed.
+        }
+        if (!keep || stopping_) {
+            close(fd);
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            returned_.push_back(fd);
+        }
+        const char byte = 0;
+        [[maybe_unused]] const ssize_t written = write(return_fds_[1], &byte, 1);
+    }
+}
+
+// Latency counts from when the request was seen to arrive, queueing included.
+bool Server::ServeNextRequest(int fd, double queued_us) {
+    ServeRequest request;
+    uint64_t input_size = 0;
+    if (!ReceiveRequestHeader(fd, request, input_size)) {
+        return false;
+    }
+    if (!ReserveInput(input_size)) {
+        // The input is left unread, so the connection cannot carry another request.
+        SendResponse(fd, {false, "Server is short of memory for a " + std::to_string(input_size) +
+                                     "-byte input; try again later"});
+        if (request.type == ServeRequestType::Run) {
+            RecordLatency(NowMicroseconds() - queued_us, false);
+        }
+        return false;
+    }
+    const InputReservation reservation(input_reserved_, input_size);
+    request.input_bytes = ReadString(fd, input_size, KMaxInputBytes);
+
+    const ServeResponse response = Handle(request);
+    SendResponse(fd, response);
+    if (request.type == ServeRequestType::Run) {
+        RecordLatency(NowMicroseconds() - queued_us, response.ok);
+    }
+    return true;
+}
+
+bool Server::ReserveInput(uint64_t bytes) {
+    uint64_t reserved = input_reserved_.load();
+    do {
+        if (bytes > input_budget_ - reserved) {
+            return false;
+        }
+    } while (!input_reserved_.compare_exchange_weak(reserved, reserved + bytes));
+    return true;
+}
+
+ServeResponse Server::Handle(const ServeRequest& request) {
+    switch (request.type) {
+        case ServeRequestType::Stats:
+            return {true, GetStats()};
+        case ServeRequestType::Shutdown: {
+            stopping_ = true;
+            const char byte = 0;
+            [[maybe_unused]] const ssize_t written = write(wake_fds_[1], &byte, 1);
+            return {true, "Shutting down"};
+        }
+        case ServeRequestType::Run:
+            break;
+    }
+
+    try {
+        if (request.args.size() < 2) {
+            throw std::runtime_error("Input and output paths are required");
+        }
+        const std::vector<FilterPtr> filters = GetFilters(request.args);
+        const std::string& output = request.args[1];
+
+        const std::optional<CropWindow> window = Executor::GetInputWindow(filters);
+        const PixelFormat format = Executor::GetInputFormat(filters, !raw_image::IsRawPath(output));
+        const size_t max_width = window ? window->width : SIZE_MAX;
+        const size_t max_height = window ? window->height : SIZE_MAX;
+        const auto& bytes = request.input_bytes;
+        Image image = (bytes.empty() ? reader::GetFileReader(request.args[0], format, max_width, max_height, &pool_)
+                                     : reader::GetBMPMemoryReader(reinterpret_cast<const uint8_t*>(bytes.data()),
+                                                                  bytes.size(), format, max_width, max_height, &pool_))
+                          ->GetImage();
+        Executor(pool_).Run(image, filters);
+        writer::GetFileWriter(output, false, &pool_)->Write(image);
+        return {true, "Output saved to: " + output};
+    } catch (const std::exception& e) {
+        return {false, e.what()};
+    }
+}
+
+// Chains are keyed on their spelling; a chain is only stored once ArgParser accepted it.
+std::vector<FilterPtr> Server::GetFilters(const std::vector<std::string>& args) {
+    std::string key;
+    for (size_t i = 2; i < args.size(); ++i) {
+        key += args[i] + '\n';
+    }
+    {
+        std::lock_guard<std::mutex> lock(chains_mutex_);
+        const auto it = chains_.find(key);
+        if (it != chains_.end()) {
+            return it->second;
+        }
+    }
+
+    std::vector<std::string> copies = args;
+    std::string program = "serve";
+    std::vector<char*> argv = {program.data()};
+    for (std::string& arg : copies) {
+        argv.push_back(arg.data());
+    }
+    const ArgParser parser(static_cast<int>(argv.size()), argv.data());
+
+    std::lock_guard<std::mutex> lock(chains_mutex_);
+    if (chains_.size() >= KMaxCachedChains) {
+        chains_.clear();
+    }
+    chains_.emplace(key, parser.GetFilters());
+    return parser.GetFilters();
+}
+
+void Server::RecordLatency(double latency_us, bool ok) {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    ++requests_;
+    failed_ += ok ? 0 : 1;
+    if (latencies_us_.size() < KLatencySamples) {
+        latencies_us_.push_back(latency_us);
+    } else {
+        latencies_us_[next_latency_] = latency_us;
+        next_latency_ = (next_latency_ + 1) % KLatencySamples;
+    }
+}
+
+ServeClient::ServeClient(const std::string& socket_path) : fd_(ConnectTo(socket_path)) {
+}
+
+ServeClient::~ServeClient() {
+    close(fd_);
+}
+
+ServeResponse ServeClient::Send(const ServeRequest& request) {
+    try {
+        SendRequest(fd_, request);
+    } catch (const std::runtime_error&) {
+        // A busy server answers and hangs up without reading the request; its answer is still there.
+    }
+    ServeResponse response;
+    if (!ReceiveResponse(fd_, response)) {
+        throw std::runtime_error("The server closed the connection");
+    }
+    return response;
+}
@@ -0,0 +1,332 @@
+#include "stream_pipeline.h"
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+constexpr size_t KMinBandRows = 64;
+constexpr size_t KBandRowsPerThread = 32;
+constexpr size_t KMinSubBandRows = 16;
+
+void CopyRows(const Image& src, size_t src_y, Image& dst, size_t dst_y, size_t count, size_t width) {
+    for (size_t c = 0; c < Image::KChannels; ++c) {
+        for (size_t i = 0; i < count; ++i) {
+            std::copy_n(src.ChannelRow(c, src_y + i), width, dst.ChannelRow(c, dst_y + i));
+        }
+    }
+}
+
+// Runs filter.ApplyRows on rows [begin, end) split into sub-bands across the pool.
+void ApplyRowsParallel(const RowFilter& filter, const Image& src, Image& dst, size_t begin, size_t end,
+                       ThreadPool& pool) {
+    const size_t rows = end - begin;
+    const size_t bands = std::max<size_t>(1, std::min(pool.GetThreadCount(), rows / KMinSubBandRows));
+    const size_t band_rows = (rows + bands - 1) / bands;
+    pool.ParallelFor(bands, [&](size_t band) {
+        const size_t band_begin = begin + band * band_rows;
+        const size_t band_end = std::min(band_begin + band_rows, end);
+        if (band_begin < band_end) {
+            filter.ApplyRows(src, dst, band_begin, band_end);
+        }
+    });
+}
+
+// Runs plan.ApplyRows on output rows [begin, end), written from dst row 0 on, split the same way.
+void ResampleParallel(const ResamplePlan& plan, const Image& src, size_t src_y, Image& dst, size_t begin,
+                      size_t end, ThreadPool& pool) {
+    const size_t rows = end - begin;
+    const size_t bands = std::max<size_t>(1, std::min(pool.GetThreadCount(), rows / KMinSubBandRows));
+    const size_t band_rows = (rows + bands - 1) / bands;
+    pool.ParallelFor(bands, [&](size_t band) {
+        const size_t band_begin = begin + band * band_rows;
+        const size_t band_end = std::min(band_begin + band_rows, end);
+        if (band_begin < band_end) {
+            plan.ApplyRows(src, src_y, dst, band_begin - begin, band_begin, band_end);
+        }
+    });
+}
+}  // namespace
+
+// Produces the rows of an intermediate image in top-to-bottom order.
+class RowStage {
+public:
+    RowStage(size_t width, size_t height) : width_(width), height_(height) {
+    }
+    virtual ~RowStage() = default;
+
+    size_t GetWidth() const {
+        return width_;
+    }
+    size_t GetHeight() const {
+        return height_;
+    }
+
+    // Writes the next count rows into rows [dst_y, dst_y + count) of the planar image dst.
+    virtual void Pull(size_t count, Image& dst, size_t dst_y) = 0;
+
+private:
+    size_t width_;
+    size_t height_;
+};
+
+namespace {
+
+class SourceStage : public RowStage {
+public:
+    explicit SourceStage(std::shared_ptr<reader::IRowReader> source)
+        : RowStage(source->GetWidth(), source->GetHeight()), source_(std::move(source)) {
+    }
+
+    void Pull(size_t count, Image& dst, size_t dst_y) override {
+        source_->ReadRows(next_row_, count, dst, dst_y);
+        next_row_ += count;
+    }
+
+private:
+    std::shared_ptr<reader::IRowReader> source_;
+    size_t next_row_ = 0;
+};
+
+// Forwards the top-left window; rows below it are never pulled from upstream.
+class CropStage : public RowStage {
+public:
+    CropStage(std::unique_ptr<RowStage> upstream, const CropWindow& window, size_t band_rows)
+        : RowStage(std::min(window.width, upstream->GetWidth()), std::min(window.height, upstream->GetHeight())),
+          upstream_(std::move(upstream)),
+          band_(upstream_->GetWidth(), band_rows, PixelLayout::Planar) {
+    }
+
+    void Pull(size_t count, Image& dst, size_t dst_y) override {
+        if (GetWidth() == upstream_->GetWidth()) {
+            upstream_->Pull(count, dst, dst_y);
+            return;
+        }
+        for (size_t done = 0; done < count;) {
+            const size_t rows = std::min(count - done, band_.GetHeight());
+            upstream_->Pull(rows, band_, 0);
+            CopyRows(band_, 0, dst, dst_y + done, rows, GetWidth());
+            done += rows;
+        }
+    }
+
+private:
+    std::unique_ptr<RowStage> upstream_;
+    Image band_;
+};
+
+// Point filters work in place on the caller's rows.
+class PointStage : public RowStage {
+public:
+    PointStage(std::unique_ptr<RowStage> upstream, std::shared_ptr<const RowFilter> filter, ThreadPool& pool)
+        : RowStage(upstream->GetWidth(), upstream->GetHeight()),
+          upstream_(std::move(upstream)),
+          filter_(std::move(filter)),
+          pool_(pool) {
+    }
+
+    void Pull(size_t count, Image& dst, size_t dst_y) override {
+        upstream_->Pull(count, dst, dst_y);
+        ApplyRowsParallel(*filter_, dst, dst, dst_y, dst_y + count, pool_);
+    }
+
+private:
+    std::unique_ptr<RowStage> upstream_;
+    std::shared_ptr<const RowFilter> filter_;
+    ThreadPool& pool_;
+};
+
+// Keeps a window of radius + band + radius input rows. Window row j holds input row
+// clamp(y - radius + j) for the band starting at output row y, so rows past the image
+// border are replicated and the filter sees the same values as on the whole image.
+class NeighbourhoodStage : public RowStage {
+public:
+    NeighbourhoodStage(std::unique_ptr<RowStage> upstream, std::shared_ptr<const RowFilter> filter, size_t band_rows,
+                       ThreadPool& pool)
+        : RowStage(upstream->GetWidth(), upstream->GetHeight()),
+          upstream_(std::move(upstream)),
+          filter_(std::move(filter)),
+          pool_(pool),
+          radius_(filter_->GetRadius()),
+          band_rows_(band_rows),
+          window_(Image::CreateUninitialized(GetWidth(), band_rows + 2 * radius_)),
+          result_(Image::CreateUninitialized(GetWidth(), band_rows + 2 * radius_)) {
+    }
+
+    void Pull(size_t count, Image& dst, size_t dst_y) override {
+        for (size_t done = 0; done < count;) {
+            const size_t rows = std::min(count - done, band_rows_);
+            PullBand(rows, dst, dst_y + done);
+            done += rows;
+        }
+    }
+
+private:
+    void PullBand(size_t count, Image& dst, size_t dst_y) {
+        size_t first_row = 0;
+        if (next_row_ > 0) {
+            // The last 2 * radius rows of the previous window start this one.
+            CopyRows(window_, previous_count_, window_, 0, 2 * radius_, GetWidth());
+            first_row = 2 * radius_;
+        }
+        const size_t end_row = count + 2 * radius_;
+
+        // Rows inside the image form one contiguous range of the window; pull it in one go.
+        const auto input_row = [&](size_t j) {
+            return static_cast<ptrdiff_t>(next_row_ + j) - static_cast<ptrdiff_t>(radius_);
+        };
+        size_t real_begin = first_row;
+        while (real_begin < end_row && input_row(real_begin) < 0) {
+            ++real_begin;
+        }
+        size_t real_end = real_begin;
+        while (real_end < end_row && input_row(real_end) < static_cast<ptrdiff_t>(GetHeight())) {
+            ++real_end;
+        }
+        upstream_->Pull(real_end - real_begin, window_, real_begin);
+
+        for (size_t j = first_row; j < real_begin; ++j) {
+            CopyRows(window_, real_begin, window_, j, 1, GetWidth());
+        }
+        for (size_t j = std::max(real_end, first_row); j < end_row; ++j) {
+            CopyRows(window_, j - 1, window_, j, 1, GetWidth());
+        }
+
+        ApplyRowsParallel(*filter_, window_, result_, radius_, radius_ + count, pool_);
+        CopyRows(result_, radius_, dst, dst_y, count, GetWidth());
+
+        next_row_ += count;
+        previous_count_ = count;
+    }
+
+    std::unique_ptr<RowStage> upstream_;
+    std::shared_ptr<const RowFilter> filter_;
+    ThreadPool& pool_;
+    size_t radius_;
+    size_t band_rows_;
+    Image window_;
+    Image result_;
+    size_t next_row_ = 0;
+    size_t previous_count_ = 0;
+};
+
+// Keeps the input rows the next output band reads. Rows above it are dropped and the rows below
+// pulled as the band moves down, so every input row is pulled once.
+class ResampleStage : public RowStage {
+public:
+    ResampleStage(std::unique_ptr<RowStage> upstream, std::unique_ptr<ResamplePlan> plan, size_t band_rows,
+                  ThreadPool& pool)
+        : RowStage(plan->GetWidth(), plan->GetHeight()),
+          upstream_(std::move(upstream)),
+          plan_(std::move(plan)),
+          pool_(pool),
+          band_rows_(band_rows),
+          window_(Image::CreateUninitialized(upstream_->GetWidth(), GetFirstSpanRows())),
+          result_(Image::CreateUninitialized(GetWidth(), band_rows)) {
+    }
+
+    void Pull(size_t count, Image& dst, size_t dst_y) override {
+        for (size_t done = 0; done < count;) {
+            const size_t rows = std::min(count - done, band_rows_);
+            PullBand(rows, dst, dst_y + done);
+            done += rows;
+        }
+    }
+
+private:
+    // The window grows when a later band reads more rows.
+    size_t GetFirstSpanRows() const {
+        const RowSpan span = plan_->GetInputRows(0, std::min(band_rows_, GetHeight()));
+        return span.last - span.first;
+    }
+
+    void PullBand(size_t count, Image& dst, size_t dst_y) {
+        const RowSpan span = plan_->GetInputRows(next_row_, next_row_ + count);
+        const size_t width = upstream_->GetWidth();
+
+        const size_t window_end = window_first_ + window_rows_;
+        const size_t keep_from = std::clamp(span.first, window_first_, window_end);
+        if (keep_from > window_first_) {
+            CopyRows(window_, keep_from - window_first_, window_, 0, window_end - keep_from, width);
+        }
+        window_first_ = keep_from;
+        window_rows_ = window_end - keep_from;
+
+        if (span.last - window_first_ > window_.GetHeight()) {
+            Image grown = Image::CreateUninitialized(width, span.last - window_first_);
+            CopyRows(window_, 0, grown, 0, window_rows_, width);
+            window_ = std::move(grown);
+        }
+        if (span.last > window_end) {
+            upstream_->Pull(span.last - window_end, window_, window_rows_);
+            window_rows_ = span.last - window_first_;
+        }
+
+        ResampleParallel(*plan_, window_, window_first_, result_, next_row_, next_row_ + count, pool_);
+        CopyRows(result_, 0, dst, dst_y, count, GetWidth());
+        next_row_ += count;
+    }
+
+    std::unique_ptr<RowStage> upstream_;
+    std::unique_ptr<ResamplePlan> plan_;
+    ThreadPool& pool_;
+    size_t band_rows_;
+    // Input rows [window_first_, window_first_ + window_rows_).
+    Image window_;
+    size_t window_first_ = 0;
+    size_t window_rows_ = 0;
+    Image result_;
+    size_t next_row_ = 0;
+};
+
+}  // namespace
+
+StreamPipeline::StreamPipeline(std::shared_ptr<reader::IRowReader> source, const std::vector<FilterPtr>& filters,
+                               ThreadPool& pool) {
+    const std::vector<FilterPtr> chain = FusePointFilters(filters);
+
+    size_t max_radius = 0;
+    for (const FilterPtr& filter : chain) {
+        if (const auto* row_filter = dynamic_cast<const RowFilter*>(filter.get())) {
+            max_radius = std::max(max_radius, row_filter->GetRadius());
+        } else if (filter->GetCropWindow() == nullptr && dynamic_cast<const ResampleFilter*>(filter.get()) == nullptr) {
+            throw std::runtime_error("The filter chain cannot be run in streaming mode");
+        }
+    }
+    band_rows_ = std::max({KMinBandRows, KBandRowsPerThread * pool.GetThreadCount(), 2 * max_radius});
+
+    std::unique_ptr<RowStage> stage = std::make_unique<SourceStage>(std::move(source));
+    for (const FilterPtr& filter : chain) {
+        auto row_filter = std::dynamic_pointer_cast<const RowFilter>(filter);
+        if (const auto* resample = dynamic_cast<const ResampleFilter*>(filter.get())) {
+            std::unique_ptr<ResamplePlan> plan = resample->Prepare(stage->GetWidth(), stage->GetHeight());
+            stage = std::make_unique<ResampleStage>(std::move(stage), std::move(plan), band_rows_, pool);
+        } else if (row_filter == nullptr) {
+            stage = std::make_unique<CropStage>(std::move(stage), *filter->GetCropWindow(), band_rows_);
+        } else if (row_filter->GetRadius() == 0) {
+            stage = std::make_unique<PointStage>(std::move(stage), std::move(row_filter), pool);
+        } else {
+            stage = std::make_unique<NeighbourhoodStage>(std::move(stage), std::move(row_filter), band_rows_, pool);
+        }
+    }
+    last_stage_ = std::move(stage);
+}
+
+StreamPipeline::~StreamPipeline() = default;
+
+size_t StreamPipeline::GetWidth() const {
+    return last_stage_->GetWidth();
+}
+
+size_t StreamPipeline::GetHeight() const {
+    return last_stage_->GetHeight();
+}
+
+void StreamPipeline::Run(writer::IRowWriter& sink) {
+    Image band = Image::CreateUninitialized(GetWidth(), band_rows_);
+    for (size_t y = 0; y < GetHeight(); y += band_rows_) {
+        const size_t count = std::min(band_rows_, GetHeight() - y);
+        last_stage_->Pull(count, band, 0);
+        sink.WriteRows(y, band, 0, count);
+    }
+}
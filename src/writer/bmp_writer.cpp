@@ -1,26 +1,41 @@
 #include "writer.h"
 #include "image.h"
-#include <fstream>
+#include "posix_file.h"
+#include "thread_pool.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
 #include <vector>
 #include <stdexcept>
+#include <string>
 #include <cstdint>
 #include <algorithm>
 
 namespace {
 constexpr int KBmpBitsPerPixel = 24;
 constexpr int KBmpCompressionNone = 0;
-constexpr float KColorNormalizationFactor = 255.0f;
 constexpr int KBytesPerPixel = 3;
 constexpr int KPaddingAlignment = 4;
 constexpr int KBmpHeaderSize = 54;
-constexpr float KRoundingOffset = 0.5f;
 constexpr int KPixelsPerMeter = 2835;
-
-inline uint8_t SafeColorConvert(float value) {
-    float normalized = value * KColorNormalizationFactor;
-    float clamped = std::clamp(normalized, 0.0f, KColorNormalizationFactor);
-    return static_cast<uint8_t>(clamped + KRoundingOffset);
-}
+constexpr size_t KEncodeChunkPixels = 256;
+// BMPWriter hands the file to the I/O thread in blocks of this size; a multiple of the
+// O_DIRECT alignment.
+constexpr size_t KWriteBlockBytes = size_t{4} << 20;
+constexpr size_t KDirectIoAlignment = 4096;
+// With a pool, files are cut into about this many blocks per thread, each encoded and written
+// by whichever thread takes it; blocks stay within these bounds.
+constexpr size_t KBlocksPerThread = 4;
+constexpr size_t KMinParallelBlockBytes = size_t{256} << 10;
 }  // namespace
 
 #pragma pack(push, 1)
@@ -44,66 +59,438 @@ struct BmpHeader {
 };
 #pragma pack(pop)
 
+namespace {
+size_t RowSize(size_t width) {
+    return (width * KBytesPerPixel + KPaddingAlignment - 1) & ~(KPaddingAlignment - 1);
+}
+
+BmpHeader MakeHeader(size_t width, size_t height) {
+    const size_t image_size = RowSize(width) * height;
+    BmpHeader header;
+    header.width = static_cast<int32_t>(width);
+    header.height = static_cast<int32_t>(height);
+    header.size = static_cast<uint32_t>(KBmpHeaderSize + image_size);
+    header.image_size = static_cast<uint32_t>(image_size);
+    return header;
+}
+
+// Quantises each channel of a chunk in its own loop, which the compiler vectorises, and only
+// then interleaves the bytes. The one plane of a Mono image is quantised once and repeated.
+template <typename T, typename Convert>
+void EncodePlanarRow(const Image& image, size_t y, uint8_t* row, Convert convert) {
+    const size_t channels = image.GetLayout() == PixelLayout::Mono ? 1 : Image::KChannels;
+    const T* planes[Image::KChannels] = {image.ChannelRow<T>(0, y), image.ChannelRow<T>(1, y),
+                                          image.ChannelRow<T>(2, y)};
+    uint8_t bytes[Image::KChannels][KEncodeChunkPixels];
+    const uint8_t* red = bytes[0];
+    const uint8_t* green = bytes[channels == 1 ? 0 : 1];
+    const uint8_t* blue = bytes[channels == 1 ? 0 : 2];
+    for (size_t x0 = 0; x0 < image.GetWidth(); x0 += KEncodeChunkPixels) {
+        const size_t count = std::min(KEncodeChunkPixels, image.GetWidth() - x0);
+        for (size_t c = 0; c < channels; ++c) {
+            const T* plane = planes[c] + x0;
+            for (size_t i = 0; i < count; ++i) {
+                bytes[c][i] = convert(plane[i]);
+            }
+        }
+        uint8_t* out = row + x0 * KBytesPerPixel;
+        for (size_t i = 0; i < count; ++i) {
+            out[i * KBytesPerPixel + 0] = blue[i];
+            out[i * KBytesPerPixel + 1] = green[i];
+            out[i * KBytesPerPixel + 2] = red[i];
+        }
+    }
+}
+
+// Fills the first width * 3 bytes of row with image row y as BGR24; the padding is left untouched.
+void EncodeRow(const Image& image, size_t y, uint8_t* row) {
+    if (image.GetLayout() == PixelLayout::Interleaved) {
+        const Pixel* pixels = image.Row(y);
+        for (size_t x = 0; x < image.GetWidth(); ++x) {
+            const size_t offset = x * KBytesPerPixel;
+            row[offset + 0] = pixel::ToByte(pixels[x].b);  // B
+            row[offset + 1] = pixel::ToByte(pixels[x].g);  // G
+            row[offset + 2] = pixel::ToByte(pixels[x].r);  // R
+        }
+        return;
+    }
+
+    switch (image.GetFormat()) {
+        case PixelFormat::UInt8:
+            EncodePlanarRow<uint8_t>(image, y, row, [](uint8_t value) { return value; });
+            break;
+        case PixelFormat::UInt16:
+            EncodePlanarRow<uint16_t>(image, y, row,
+                                      [](uint16_t value) { return pixel::ToByte(pixel::FromWord(value)); });
+            break;
+        case PixelFormat::Float32:
+            EncodePlanarRow<float>(image, y, row, pixel::ToByte);
+            break;
+    }
+}
+
+struct FreeDeleter {
+    void operator()(uint8_t* data) const {
+        std::free(data);
+    }
+};
+using BlockBuffer = std::unique_ptr<uint8_t[], FreeDeleter>;
+
+BlockBuffer AllocateBlock() {
+    BlockBuffer block(static_cast<uint8_t*>(std::aligned_alloc(KDirectIoAlignment, KWriteBlockBytes)));
+    if (!block) {
+        throw std::bad_alloc();
+    }
+    return block;
+}
+
+void CheckSize(const Image& image) {
+    if (image.GetWidth() == 0 || image.GetHeight() == 0) {
+        throw std::runtime_error("Image dimensions cannot be zero");
+    }
+}
+
+// Fills out with bytes [begin, begin + length) of the BMP file of image, which must lie within
+// the file. Rows cut by either end of the range are encoded into row first.
+void EncodeFileBytes(const Image& image, size_t begin, size_t length, uint8_t* out, std::vector<uint8_t>& row) {
+    const size_t height = image.GetHeight();
+    const size_t row_size = RowSize(image.GetWidth());
+    const size_t padding = row_size - image.GetWidth() * KBytesPerPixel;
+    const size_t end = begin + length;
+    size_t position = begin;
+    if (position < KBmpHeaderSize) {
+        const BmpHeader header = MakeHeader(image.GetWidth(), height);
+        const size_t part = std::min<size_t>(end, KBmpHeaderSize) - position;
+        std::memcpy(out, reinterpret_cast<const uint8_t*>(&header) + position, part);
+        position += part;
+    }
+    while (position < end) {
+        const size_t file_row = (position - KBmpHeaderSize) / row_size;
+        const size_t row_begin = KBmpHeaderSize + file_row * row_size;
+        const size_t part_begin = position - row_begin;
+        const size_t part_end = std::min(row_size, end - row_begin);
+        uint8_t* target = out + (position - begin);
+        if (part_begin == 0 && part_end == row_size) {
+            EncodeRow(image, height - 1 - file_row, target);
+            std::memset(target + row_size - padding, 0, padding);
+        } else {
+            row.resize(row_size);
+            EncodeRow(image, height - 1 - file_row, row.data());
+            std::memset(row.data() + row_size - padding, 0, padding);
+            std::memcpy(target, row.data() + part_begin, part_end - part_begin);
+        }
+        position = row_begin + part_end;
+    }
+}
+
+// Passes filled block buffers from the encoding thread to the I/O thread, in file order. A buffer
+// is taken for encoding only once its previous block has been written; the first failed write
+// stops the hand-off and is rethrown to the encoder.
+class BlockQueue {
+public:
+    struct Block {
+        size_t buffer;
+        const uint8_t* data;
+        size_t length;
+        size_t offset;
+    };
+
+    void Acquire(size_t buffer) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [&] { return !busy_[buffer] || error_; });
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+        busy_[buffer] = true;
+    }
+
+    void Push(const Block& block) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            blocks_.push_back(block);
+        }
+        cv_.notify_all();
+    }
+
+    // False once the queue is closed and drained, or a write failed.
+    bool Pop(Block& block) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [&] { return !blocks_.empty() || closed_ || error_; });
+        if (blocks_.empty() || error_) {
+            return false;
+        }
+        block = blocks_.front();
+        blocks_.pop_front();
+        return true;
+    }
+
+    void Release(size_t buffer, std::exception_ptr error) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            busy_[buffer] = false;
+            if (!error_) {
+                error_ = error;
+            }
+        }
+        cv_.notify_all();
+    }
+
+    void Close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+        }
+        cv_.notify_all();
+    }
+
+    void RethrowError() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Block> blocks_;
+    bool busy_[2] = {false, false};
+    bool closed_ = false;
+    std::exception_ptr error_;
+};
+
+// Encodes the file as one stream of fixed-size blocks. Rows are quantised into one of two block
+// buffers while a single I/O thread, started for this file, writes the other one with
+// write_block(data, length, offset); blocks are written in file order. The last block is padded
+// with garbage to a multiple of tail_alignment.
+template <typename WriteBlock>
+void EncodeBlocks(const Image& image, size_t tail_alignment, WriteBlock write_block) {
+    const size_t size = writer::GetBMPFileSize(image.GetWidth(), image.GetHeight());
+    BlockBuffer buffers[2] = {AllocateBlock(), AllocateBlock()};
+    BlockQueue queue;
+    std::thread io([&queue, &write_block] {
+        BlockQueue::Block block{};
+        while (queue.Pop(block)) {
+            std::exception_ptr error;
+            try {
+                write_block(block.data, block.length, block.offset);
+            } catch (...) {
+                error = std::current_exception();
+            }
+            queue.Release(block.buffer, error);
+        }
+    });
+
+    try {
+        std::vector<uint8_t> row;
+        for (size_t offset = 0, current = 0; offset < size; offset += KWriteBlockBytes, current ^= 1) {
+            queue.Acquire(current);
+            const size_t length = std::min(KWriteBlockBytes, size - offset);
+            uint8_t* data = buffers[current].get();
+            EncodeFileBytes(image, offset, length, data, row);
+            const size_t padded = (length + tail_alignment - 1) / tail_alignment * tail_alignment;
+            queue.Push({current, data, padded, offset});
+        }
+    } catch (...) {
+        queue.Close();
+        io.join();
+        throw;
+    }
+    queue.Close();
+    io.join();
+    queue.RethrowError();
+}
+
+// Cuts the file into aligned blocks that the threads of the pool encode and hand to
+// write_block(data, length, offset) independently, in no particular order; for positional
+// writes to a preallocated file. The last block is padded as in EncodeBlocks.
+template <typename WriteBlock>
+void EncodeBlocksParallel(const Image& image, size_t tail_alignment, ThreadPool& pool, WriteBlock write_block) {
+    const size_t size = writer::GetBMPFileSize(image.GetWidth(), image.GetHeight());
+    const size_t target = size / (pool.GetThreadCount() * KBlocksPerThread);
+    const size_t block_bytes =
+        std::clamp((target + KDirectIoAlignment - 1) / KDirectIoAlignment * KDirectIoAlignment,
+                   KMinParallelBlockBytes, KWriteBlockBytes);
+    pool.ParallelFor((size + block_bytes - 1) / block_bytes, [&](size_t block) {
+        thread_local BlockBuffer buffer = AllocateBlock();
+        thread_local std::vector<uint8_t> row;
+        const size_t offset = block * block_bytes;
+        const size_t length = std::min(block_bytes, size - offset);
+        EncodeFileBytes(image, offset, length, buffer.get(), row);
+        write_block(buffer.get(), (length + tail_alignment - 1) / tail_alignment * tail_alignment, offset);
+    });
+}
+}  // namespace
+
 namespace writer {
 
+// The file is preallocated; in direct I/O mode the blocks bypass the page cache and the file is
+// trimmed to its real length at the end. Given a pool, the blocks are encoded and written by all
+// of its threads at once.
 class BMPWriter : public IWriter {
 public:
-    explicit BMPWriter(const std::string& path) : path_(path) {
+    BMPWriter(const std::string& path, bool direct_io, ThreadPool* pool)
+        : path_(path), direct_io_(direct_io), pool_(pool) {
     }
 
     void Write(const Image& image) const override {
-        const size_t width = image.GetWidth();
-        const size_t height = image.GetHeight();
+        CheckSize(image);
+        const size_t size = GetBMPFileSize(image.GetWidth(), image.GetHeight());
+        bool direct = false;
+        const std::unique_ptr<PosixFile> file = Open(direct);
+        file->Allocate(size);
+        const size_t tail_alignment = direct ? KDirectIoAlignment : 1;
+        const auto write_block = [&file](const uint8_t* data, size_t length, uint64_t offset) {
+            file->WriteAt(data, length, offset);
+        };
+        if (pool_ != nullptr && pool_->GetThreadCount() > 1 && size > KMinParallelBlockBytes) {
+            EncodeBlocksParallel(image, tail_alignment, *pool_, write_block);
+        } else {
+            EncodeBlocks(image, tail_alignment, write_block);
+        }
+        if (direct) {
+            file->Truncate(size);
+        }
+    }
 
-        if (width == 0 || height == 0) {
-            throw std::runtime_error("Image dimensions cannot be zero");
+private:
+    // Falls back to buffered I/O on file systems that refuse O_DIRECT.
+    std::unique_ptr<PosixFile> Open(bool& direct) const {
+        constexpr int KFlags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+        if (direct_io_) {
+            try {
+                auto file = std::make_unique<PosixFile>(path_, KFlags | O_DIRECT);
+                direct = true;
+                return file;
+            } catch (const std::runtime_error&) {
+            }
+        }
+#endif
+        try {
+            return std::make_unique<PosixFile>(path_, KFlags);
+        } catch (const std::runtime_error&) {
+            throw std::runtime_error("Failed to create output file: " + path_);
         }
+    }
 
-        const size_t row_size = (width * KBytesPerPixel + KPaddingAlignment - 1) & ~(KPaddingAlignment - 1);
-        const size_t image_size = row_size * height;
-        const size_t file_size = KBmpHeaderSize + image_size;
+    std::string path_;
+    bool direct_io_;
+    ThreadPool* pool_;
+};
 
-        BmpHeader header;
-        header.width = static_cast<int32_t>(width);
-        header.height = static_cast<int32_t>(height);
-        header.size = static_cast<uint32_t>(file_size);
-        header.image_size = static_cast<uint32_t>(image_size);
+// Encodes into the caller's buffer, which is never written past the file size; given a pool, in
+// bands of rows on its threads.
+class BMPMemoryWriter : public IWriter {
+public:
+    BMPMemoryWriter(uint8_t* buffer, size_t capacity, ThreadPool* pool)
+        : buffer_(buffer), capacity_(capacity), pool_(pool) {
+    }
 
-        std::ofstream file(path_, std::ios::binary);
-        if (!file.is_open()) {
-            throw std::runtime_error("Failed to create output file: " + path_);
+    void Write(const Image& image) const override {
+        CheckSize(image);
+        const size_t size = GetBMPFileSize(image.GetWidth(), image.GetHeight());
+        if (size > capacity_) {
+            throw std::length_error("A " + std::to_string(size) + "-byte BMP does not fit into a buffer of " +
+                                    std::to_string(capacity_) + " bytes");
         }
 
-        if (!file.write(reinterpret_cast<const char*>(&header), sizeof(header))) {
-            throw std::runtime_error("Failed to write BMP header");
+        if (pool_ == nullptr || pool_->GetThreadCount() == 1 || size <= KMinParallelBlockBytes) {
+            std::vector<uint8_t> row;
+            EncodeFileBytes(image, 0, size, buffer_, row);
+            return;
         }
+        const size_t bands = pool_->GetThreadCount() * KBlocksPerThread;
+        const size_t band_bytes = (size + bands - 1) / bands;
+        pool_->ParallelFor(bands, [&](size_t band) {
+            thread_local std::vector<uint8_t> row;
+            const size_t offset = std::min(size, band * band_bytes);
+            EncodeFileBytes(image, offset, std::min(band_bytes, size - offset), buffer_ + offset, row);
+        });
+    }
 
-        std::vector<uint8_t> row(row_size, 0);
-        for (size_t y = 0; y < height; ++y) {
-            const size_t target_y = height - 1 - y;
-            for (size_t x = 0; x < width; ++x) {
-                const Pixel& p = image.GetPixel(x, target_y);
-                const size_t offset = x * KBytesPerPixel;
-                row[offset + 0] = SafeColorConvert(p.b);  // B
-                row[offset + 1] = SafeColorConvert(p.g);  // G
-                row[offset + 2] = SafeColorConvert(p.r);  // R
-            }
+private:
+    uint8_t* buffer_;
+    size_t capacity_;
+    ThreadPool* pool_;
+};
 
-            if (!file.write(reinterpret_cast<const char*>(row.data()), static_cast<std::streamsize>(row_size))) {
-                throw std::runtime_error("Failed to write BMP row data");
+// Standard output may be a pipe, so blocks are written in order with plain writes.
+class ConsoleWriter : public IWriter {
+public:
+    void Write(const Image& image) const override {
+        CheckSize(image);
+        EncodeBlocks(image, 1, [](const uint8_t* data, size_t length, uint64_t) {
+            for (size_t done = 0; done < length;) {
+                const ssize_t written = write(STDOUT_FILENO, data + done, length - done);
+                if (written < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (written < 0) {
+                    throw std::runtime_error("Failed to write standard output");
+                }
+                done += static_cast<size_t>(written);
             }
+        });
+    }
+};
+
+// Preallocates the whole file so that bands can be written top to bottom with positional
+// writes, although BMP stores the rows bottom-up.
+class BMPRowWriter : public IRowWriter {
+public:
+    BMPRowWriter(const std::string& path, size_t width, size_t height)
+        : file_(path, O_WRONLY | O_CREAT | O_TRUNC), width_(width), height_(height), row_size_(RowSize(width)) {
+        if (width == 0 || height == 0) {
+            throw std::runtime_error("Image dimensions cannot be zero");
         }
 
-        if (!file.good()) {
-            throw std::runtime_error("Error occurred during BMP file writing");
+        const BmpHeader header = MakeHeader(width, height);
+        file_.Allocate(header.size);
+        file_.WriteAt(&header, sizeof(header), 0);
+    }
+
+    void WriteRows(size_t y, const Image& src, size_t src_y, size_t count) override {
+        if (count == 0) {
+            return;
+        }
+        if (y + count > height_ || src.GetWidth() != width_) {
+            throw std::out_of_range("BMP row range out of range");
+        }
+
+        // Image rows [y, y + count) are one contiguous block of file rows in reverse order.
+        buffer_.assign(count * row_size_, 0);
+        for (size_t i = 0; i < count; ++i) {
+            EncodeRow(src, src_y + i, buffer_.data() + (count - 1 - i) * row_size_);
         }
+        file_.WriteAt(buffer_.data(), buffer_.size(), KBmpHeaderSize + (height_ - y - count) * row_size_);
     }
 
 private:
-    std::string path_;
+    PosixFile file_;
+    size_t width_;
+    size_t height_;
+    size_t row_size_;
+    std::vector<uint8_t> buffer_;
 };
 
-std::shared_ptr<IWriter> GetBMPWriter(const std::string& path) {
-    return std::make_shared<BMPWriter>(path);
+std::shared_ptr<IWriter> GetBMPWriter(const std::string& path, bool direct_io, ThreadPool* pool) {
+    return std::make_shared<BMPWriter>(path, direct_io, pool);
+}
+
+std::shared_ptr<IRowWriter> GetBMPRowWriter(const std::string& path, size_t width, size_t height) {
+    return std::make_shared<BMPRowWriter>(path, width, height);
+}
+
+std::shared_ptr<IWriter> GetBMPMemoryWriter(uint8_t* buffer, size_t capacity, ThreadPool* pool) {
+    return std::make_shared<BMPMemoryWriter>(buffer, capacity, pool);
+}
+
+std::shared_ptr<IWriter> GetConsoleWriter() {
+    return std::make_shared<ConsoleWriter>();
+}
+
+size_t GetBMPFileSize(size_t width, size_t height) {
+    return KBmpHeaderSize + RowSize(width) * height;
 }
 }  // namespace writer
\ No newline at end of file
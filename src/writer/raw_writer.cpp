@@ -0,0 +1,147 @@
+#include "writer.h"
+#include "image.h"
+#include "posix_file.h"
+#include "raw_image.h"
+#include <fcntl.h>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+// Rows are gathered into blocks of about this size before each positional write.
+constexpr size_t KWriteBlockBytes = size_t{4} << 20;
+
+raw_image::Header MakeHeader(size_t width, size_t height, PixelFormat format) {
+    if (width == 0 || height == 0) {
+        throw std::runtime_error("Image dimensions cannot be zero");
+    }
+    raw_image::Header header{};
+    std::memcpy(header.magic, raw_image::KMagic, sizeof(header.magic));
+    header.version = raw_image::KVersion;
+    header.format = static_cast<uint32_t>(format);
+    header.width = width;
+    header.height = height;
+    header.row_bytes = Image::GetRowBytes(width, PixelLayout::Planar, format);
+    header.data_offset = raw_image::KDataOffset;
+    return header;
+}
+
+// Sets the file to its final size, so row padding reads back as zeros, and writes the header.
+void WriteHeader(const PosixFile& file, const raw_image::Header& header) {
+    file.Allocate(header.data_offset + Image::KChannels * raw_image::GetPlaneBytes(header));
+    file.WriteAt(&header, sizeof(header), 0);
+}
+
+// Writes rows [src_y, src_y + count) of planar src as file rows [y, y + count).
+void WritePlaneRows(const PosixFile& file, const raw_image::Header& header, const Image& src, size_t src_y, size_t y,
+                    size_t count, std::vector<uint8_t>& buffer) {
+    const size_t row_size = src.GetWidth() * Image::GetElementSize(src.GetFormat());
+    const size_t rows_per_block = std::max<size_t>(1, KWriteBlockBytes / header.row_bytes);
+    for (size_t c = 0; c < Image::KChannels; ++c) {
+        for (size_t first = 0; first < count; first += rows_per_block) {
+            const size_t rows = std::min(rows_per_block, count - first);
+            buffer.assign(rows * header.row_bytes, 0);
+            for (size_t i = 0; i < rows; ++i) {
+                std::memcpy(buffer.data() + i * header.row_bytes, src.ChannelRow<uint8_t>(c, src_y + first + i),
+                            row_size);
+            }
+            file.WriteAt(buffer.data(), buffer.size(),
+                         header.data_offset + c * raw_image::GetPlaneBytes(header) + (y + first) * header.row_bytes);
+        }
+    }
+}
+}  // namespace
+
+namespace writer {
+
+// Stores the image in its own pixel format. The image may be a copy-on-write mapping of the very
+// file it replaces, whose untouched pages would read back as zeros once the file is truncated,
+// so it is written under a temporary name that is then renamed over the path.
+class RawWriter : public IWriter {
+public:
+    explicit RawWriter(const std::string& path) : path_(path) {
+    }
+
+    void Write(const Image& image) const override {
+        if (image.GetLayout() != PixelLayout::Planar) {
+            Image planar = image;
+            planar.SetLayout(PixelLayout::Planar);
+            Write(planar);
+            return;
+        }
+
+        const raw_image::Header header = MakeHeader(image.GetWidth(), image.GetHeight(), image.GetFormat());
+        const std::string temporary = MakeTemporaryPath(path_);
+        try {
+            {
+                const PosixFile file(temporary, O_WRONLY | O_CREAT | O_TRUNC);
+                WriteHeader(file, header);
+                std::vector<uint8_t> buffer;
+                WritePlaneRows(file, header, image, 0, 0, image.GetHeight(), buffer);
+            }
+            std::filesystem::rename(temporary, path_);
+        } catch (...) {
+            std::error_code error;
+            std::filesystem::remove(temporary, error);
+            throw;
+        }
+    }
+
+private:
+    std::string path_;
+};
+
+// Streamed images are stored as Float32, the format the stream pipeline works in.
+class RawRowWriter : public IRowWriter {
+public:
+    RawRowWriter(const std::string& path, size_t width, size_t height)
+        : header_(MakeHeader(width, height, PixelFormat::Float32)), file_(path, O_WRONLY | O_CREAT | O_TRUNC) {
+        WriteHeader(file_, header_);
+    }
+
+    void WriteRows(size_t y, const Image& src, size_t src_y, size_t count) override {
+        if (count == 0) {
+            return;
+        }
+        if (y + count > header_.height || src.GetWidth() != header_.width) {
+            throw std::out_of_range("Raw image row range out of range");
+        }
+        if (src.GetLayout() != PixelLayout::Planar || src.GetFormat() != PixelFormat::Float32) {
+            throw std::invalid_argument("Raw row writer expects planar Float32 rows");
+        }
+        WritePlaneRows(file_, header_, src, src_y, y, count, buffer_);
+    }
+
+private:
+    raw_image::Header header_;
+    PosixFile file_;
+    std::vector<uint8_t> buffer_;
+};
+
+std::shared_ptr<IWriter> GetRawWriter(const std::string& path) {
+    return std::make_shared<RawWriter>(path);
+}
+
+std::shared_ptr<IRowWriter> GetRawRowWriter(const std::string& path, size_t width, size_t height) {
+    return std::make_shared<RawRowWriter>(path, width, height);
+}
+
+std::shared_ptr<IWriter> GetFileWriter(const std::string& path, bool direct_io, ThreadPool* pool) {
+    if (path == KConsolePath) {
+        return GetConsoleWriter();
+    }
+    if (raw_image::IsRawPath(path)) {
+        return GetRawWriter(path);
+    }
+    return GetBMPWriter(path, direct_io, pool);
+}
+
+std::shared_ptr<IRowWriter> GetFileRowWriter(const std::string& path, size_t width, size_t height) {
+    if (raw_image::IsRawPath(path)) {
+        return GetRawRowWriter(path, width, height);
+    }
+    return GetBMPRowWriter(path, width, height);
+}
+}  // namespace writer
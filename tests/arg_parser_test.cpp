@@ -0,0 +1,99 @@
+#include "arg_parser.h"
+#include "image.h"
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Checks the ends of parameter ranges: everything ArgParser accepts has to build a filter that
+// runs, and everything else has to be refused before any filter is built, as --serve relies on.
+
+namespace {
+struct Case {
+    std::vector<std::string> filters;
+    bool accepted;
+};
+
+bool Parses(const std::vector<std::string>& filters, std::vector<FilterPtr>& built) {
+    std::vector<std::string> args = {"image_processor", "in.bmp", "out.bmp"};
+    args.insert(args.end(), filters.begin(), filters.end());
+    std::vector<char*> argv;
+    for (std::string& arg : args) {
+        argv.push_back(arg.data());
+    }
+    try {
+        const ArgParser parser(static_cast<int>(argv.size()), argv.data());
+        built = parser.GetFilters();
+        return true;
+    } catch (const std::runtime_error&) {
+        return false;
+    }
+}
+
+// Runs the filters over a small gradient and checks that every value stays a number.
+bool RunsFinite(const std::vector<FilterPtr>& filters) {
+    constexpr size_t KSide = 24;
+    Image image = Image::CreateUninitialized(KSide, KSide);
+    for (size_t c = 0; c < Image::KChannels; ++c) {
+        for (size_t y = 0; y < KSide; ++y) {
+            float* row = image.ChannelRow(c, y);
+            for (size_t x = 0; x < KSide; ++x) {
+                row[x] = static_cast<float>(x + y) / (2 * KSide);
+            }
+        }
+    }
+    for (const FilterPtr& filter : filters) {
+        filter->Apply(image);
+    }
+    for (size_t c = 0; c < Image::KChannels; ++c) {
+        for (size_t y = 0; y < image.GetHeight(); ++y) {
+            const float* row = image.ChannelRow(c, y);
+            for (size_t x = 0; x < image.GetWidth(); ++x) {
+                if (!std::isfinite(row[x])) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+}  // namespace
+
+int main() {
+    const Case cases[] = {
+        {{"-blur", "0"}, false},
+        {{"-blur", "-0"}, false},
+        {{"-blur", "-1"}, false},
+        {{"-blur", "1e-40"}, false},
+        {{"-blur", "1.17549435e-38"}, true},
+        {{"-blur", "0.5"}, true},
+        {{"-blur", "2000"}, true},
+        {{"-blur", "2000.001"}, false},
+        {{"-blur", "1e13"}, false},
+        {{"-blur", "3e38"}, false},
+        {{"-blur", "inf"}, false},
+        {{"-blur", "nan"}, false},
+        // A bad stage anywhere rejects the whole chain.
+        {{"-neg", "-blur", "2", "-gs", "-blur", "0"}, false},
+        {{"-scale", "0"}, false},
+        {{"-crop", "0", "1"}, false},
+    };
+
+    bool ok = true;
+    for (const Case& test : cases) {
+        std::vector<FilterPtr> filters;
+        const bool accepted = Parses(test.filters, filters);
+        const bool passed = accepted == test.accepted && (!accepted || RunsFinite(filters));
+        if (!passed) {
+            std::string line;
+            for (const std::string& arg : test.filters) {
+                line += " " + arg;
+            }
+            std::cout << line << ": " << (accepted ? "accepted" : "rejected") << " FAILED\n";
+        }
+        ok = ok && passed;
+    }
+    std::cout << std::size(cases) << " command lines checked\n";
+    return ok ? 0 : 1;
+}
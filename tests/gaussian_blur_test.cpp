@@ -0,0 +1,146 @@
+#include "filter.h"
+#include "image.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+// Blurs with sigmas large enough for the box cascade, whose fixed-point sums are the ones that
+// can overflow, and compares the written 8-bit levels with a direct Gaussian convolution.
+
+namespace {
+constexpr double KSigmaMultiplier = 3.0;
+constexpr double KMaxColorValue = 255.0;
+// The bound the box cascade is documented to keep against the exact kernel.
+constexpr int KMaxLevelDifference = 4;
+constexpr double KMaxMeanDifference = 1.0;
+constexpr uint32_t KSeed = 20261018;
+
+struct Case {
+    float sigma;
+    size_t width;
+    size_t height;
+};
+
+// Blocks of random colours, so the blur has hard edges to spread.
+Image MakeImage(size_t width, size_t height, std::mt19937& random) {
+    constexpr size_t KBlock = 16;
+    std::uniform_int_distribution<int> level(0, 255);
+    Image image = Image::CreateUninitialized(width, height);
+    for (size_t c = 0; c < Image::KChannels; ++c) {
+        std::vector<float> colours((width / KBlock + 1) * (height / KBlock + 1));
+        for (float& colour : colours) {
+            colour = static_cast<float>(level(random) / KMaxColorValue);
+        }
+        for (size_t y = 0; y < height; ++y) {
+            float* row = image.ChannelRow(c, y);
+            for (size_t x = 0; x < width; ++x) {
+                row[x] = colours[(y / KBlock) * (width / KBlock + 1) + x / KBlock];
+            }
+        }
+    }
+    return image;
+}
+
+// Separable Gaussian truncated at 3 sigma with edge pixels repeated, in double precision.
+std::vector<double> Convolve(const std::vector<double>& line, double sigma) {
+    const int radius = static_cast<int>(std::ceil(KSigmaMultiplier * sigma));
+    std::vector<double> kernel(2 * radius + 1);
+    double sum = 0.0;
+    for (int i = -radius; i <= radius; ++i) {
+        kernel[i + radius] = std::exp(-static_cast<double>(i) * i / (2.0 * sigma * sigma));
+        sum += kernel[i + radius];
+    }
+    const int last = static_cast<int>(line.size()) - 1;
+    std::vector<double> out(line.size());
+    for (int x = 0; x <= last; ++x) {
+        double value = 0.0;
+        for (int i = -radius; i <= radius; ++i) {
+            value += line[std::clamp(x + i, 0, last)] * kernel[i + radius];
+        }
+        out[x] = value / sum;
+    }
+    return out;
+}
+
+std::vector<double> BlurChannel(const Image& image, size_t c, double sigma) {
+    const size_t width = image.GetWidth();
+    const size_t height = image.GetHeight();
+    std::vector<double> rows(width * height);
+    for (size_t y = 0; y < height; ++y) {
+        const float* row = image.ChannelRow(c, y);
+        const std::vector<double> blurred = Convolve(std::vector<double>(row, row + width), sigma);
+        std::copy(blurred.begin(), blurred.end(), rows.begin() + y * width);
+    }
+    for (size_t x = 0; x < width; ++x) {
+        std::vector<double> column(height);
+        for (size_t y = 0; y < height; ++y) {
+            column[y] = rows[y * width + x];
+        }
+        const std::vector<double> blurred = Convolve(column, sigma);
+        for (size_t y = 0; y < height; ++y) {
+            rows[y * width + x] = blurred[y];
+        }
+    }
+    return rows;
+}
+
+int ToLevel(double value) {
+    return static_cast<int>(std::lround(std::clamp(value, 0.0, 1.0) * KMaxColorValue));
+}
+}  // namespace
+
+int main() {
+    const Case cases[] = {{8.0f, 96, 64}, {100.0f, 400, 64}, {300.0f, 512, 48}, {1000.0f, 256, 32}};
+    std::mt19937 random(KSeed);
+
+    bool ok = true;
+    for (const Case& test : cases) {
+        const Image image = MakeImage(test.width, test.height, random);
+        Image blurred = image;
+        CreateGaussianBlurFilter(test.sigma)->Apply(blurred);
+
+        int max_difference = 0;
+        double total_difference = 0.0;
+        for (size_t c = 0; c < Image::KChannels; ++c) {
+            const std::vector<double> expected = BlurChannel(image, c, test.sigma);
+            for (size_t y = 0; y < test.height; ++y) {
+                const float* row = blurred.ChannelRow(c, y);
+                for (size_t x = 0; x < test.width; ++x) {
+                    const int difference = std::abs(ToLevel(row[x]) - ToLevel(expected[y * test.width + x]));
+                    max_difference = std::max(max_difference, difference);
+                    total_difference += difference;
+                }
+            }
+        }
+        const double mean_difference =
+            total_difference / static_cast<double>(Image::KChannels * test.width * test.height);
+        const bool passed = max_difference <= KMaxLevelDifference && mean_difference <= KMaxMeanDifference;
+        std::cout << "sigma " << test.sigma << ": max " << max_difference << ", mean " << mean_difference
+                  << " levels off" << (passed ? "" : " FAILED") << "\n";
+        ok = ok && passed;
+    }
+
+    // Sigmas whose kernel would be empty or not fit in memory, or whose box widths would overflow.
+    const float rejected[] = {0.0f, -1.0f, std::numeric_limits<float>::quiet_NaN(), 1e13f, 3e38f,
+                              std::numeric_limits<float>::infinity()};
+    for (const float sigma : rejected) {
+        bool thrown = false;
+        try {
+            CreateGaussianBlurFilter(sigma);
+        } catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        if (!thrown) {
+            std::cout << "sigma " << sigma << " was not rejected FAILED\n";
+            ok = false;
+        }
+    }
+    // The largest sigma allowed builds its box cascade without touching an image.
+    CreateGaussianBlurFilter(5e8f);
+    return ok ? 0 : 1;
+}
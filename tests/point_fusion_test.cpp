@@ -0,0 +1,124 @@
+#include "filter.h"
+#include "image.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Runs every pair and triple of point filters once filter by filter and once through
+// FusePointFilters, on random 8-bit images. Where the chain has a stage that fusion may fold the
+// next one into, the written levels may differ by at most one; where it has none, because
+// every stage either quantizes or can leave [0, 1], the results must be bit-identical.
+
+namespace {
+constexpr size_t KWidth = 301;
+constexpr size_t KHeight = 67;
+constexpr int KMaxLevelDifference = 1;
+constexpr uint32_t KSeed = 20261018;
+
+struct Candidate {
+    FilterPtr filter;
+    // Whether fusion may fold the next stage into this one.
+    bool foldable;
+};
+
+std::vector<Candidate> MakeCandidates() {
+    // Doubles every channel, so its saturation clips and nothing may be folded into it.
+    const FilterPtr expanding = std::make_shared<PointFilter>(
+        std::vector<PointOp>{{{{2.0f, 0.0f, 0.0f}, {0.0f, 2.0f, 0.0f}, {0.0f, 0.0f, 2.0f}}, {0.0f, 0.0f, 0.0f}, false}},
+        "Double");
+    // Grayscale weights sum to one; sepia rows sum to more and negative quantizes.
+    return {{CreateGrayscaleFilter(), true},
+            {CreateSepiaFilter(), false},
+            {CreateNegativeFilter(), false},
+            {expanding, false}};
+}
+
+Image MakeImage(std::mt19937& random) {
+    std::uniform_int_distribution<int> level(0, 255);
+    Image image = Image::CreateUninitialized(KWidth, KHeight);
+    for (size_t c = 0; c < Image::KChannels; ++c) {
+        for (size_t y = 0; y < KHeight; ++y) {
+            float* row = image.ChannelRow(c, y);
+            for (size_t x = 0; x < KWidth; ++x) {
+                row[x] = pixel::FromByte(static_cast<uint8_t>(level(random)));
+            }
+        }
+    }
+    return image;
+}
+
+Image Run(const std::vector<FilterPtr>& filters, Image image) {
+    for (const FilterPtr& filter : filters) {
+        filter->Apply(image);
+    }
+    return image;
+}
+
+bool Check(const std::vector<Candidate>& chain, std::mt19937& random) {
+    std::vector<FilterPtr> filters;
+    std::string name;
+    bool foldable = false;
+    for (size_t i = 0; i < chain.size(); ++i) {
+        filters.push_back(chain[i].filter);
+        name += (name.empty() ? "" : " ") + chain[i].filter->GetName();
+        foldable = foldable || (chain[i].foldable && i + 1 < chain.size());
+    }
+
+    const std::vector<FilterPtr> fused_filters = FusePointFilters(filters);
+    if (fused_filters.size() != 1) {
+        std::cerr << name << ": not fused into one filter\n";
+        return false;
+    }
+    const Image image = MakeImage(random);
+    const Image separate = Run(filters, image);
+    const Image fused = Run(fused_filters, image);
+
+    int max_difference = 0;
+    bool identical = true;
+    for (size_t c = 0; c < Image::KChannels; ++c) {
+        for (size_t y = 0; y < KHeight; ++y) {
+            const float* expected = separate.ChannelRow(c, y);
+            const float* actual = fused.ChannelRow(c, y);
+            identical = identical && std::memcmp(expected, actual, KWidth * sizeof(float)) == 0;
+            for (size_t x = 0; x < KWidth; ++x) {
+                const int difference = std::abs(pixel::ToByte(expected[x]) - pixel::ToByte(actual[x]));
+                max_difference = std::max(max_difference, difference);
+            }
+        }
+    }
+    if (!foldable && !identical) {
+        std::cerr << name << ": fused across a stage that can leave [0, 1] or quantizes\n";
+        return false;
+    }
+    if (max_difference > KMaxLevelDifference) {
+        std::cerr << name << ": fused result is " << max_difference << " levels off\n";
+        return false;
+    }
+    return true;
+}
+}  // namespace
+
+int main() {
+    std::mt19937 random(KSeed);
+    const std::vector<Candidate> candidates = MakeCandidates();
+
+    size_t chains = 0;
+    size_t failures = 0;
+    for (const Candidate& first : candidates) {
+        for (const Candidate& second : candidates) {
+            chains += 1;
+            failures += Check({first, second}, random) ? 0 : 1;
+            for (const Candidate& third : candidates) {
+                chains += 1;
+                failures += Check({first, second, third}, random) ? 0 : 1;
+            }
+        }
+    }
+    std::cout << chains - failures << " of " << chains << " point filter chains fuse within bounds\n";
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,191 @@
+#include "filter.h"
+#include "filters/point_kernels.h"
+#include "image.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Runs the point kernel the dispatcher picks (IMAGE_PROCESSOR_ISA caps it) against the scalar
+// kernel, and the grayscale, sepia and negative filters against the per-pixel formulas they
+// were written as before they became point ops, and fails unless every output is bit-identical.
+
+namespace {
+constexpr size_t KRandomValues = 1 << 16;
+constexpr size_t KMaxTailCount = 67;
+constexpr float KMaxColorValue = 255.0f;
+constexpr uint32_t KSeed = 20261018;
+
+// Values whose product with 255 is exactly halfway between two integers, their neighbours, the
+// 8-bit grid itself and a few values outside [0, 1].
+std::vector<float> MakeEdgeValues() {
+    std::vector<float> values = {0.0f, -0.0f, 1.0f, -1.0f, 2.0f, -1e-7f, 1.0f + 1e-7f};
+    for (int k = 0; k < 256; ++k) {
+        values.push_back(static_cast<float>(k) / KMaxColorValue);
+        const float halfway = static_cast<float>(k) + 0.5f;
+        float value = halfway / KMaxColorValue;
+        for (int step = 0; step < 8 && value * KMaxColorValue != halfway; ++step) {
+            value = std::nextafter(value, value * KMaxColorValue < halfway ? 2.0f : -2.0f);
+        }
+        values.push_back(value);
+        values.push_back(std::nextafter(value, 2.0f));
+        values.push_back(std::nextafter(value, -2.0f));
+    }
+    return values;
+}
+
+std::vector<float> MakeRandomValues(std::mt19937& random) {
+    std::uniform_real_distribution<float> unit(-0.25f, 1.25f);
+    std::vector<float> values(KRandomValues);
+    for (float& value : values) {
+        value = unit(random);
+    }
+    return values;
+}
+
+std::vector<PointOp> MakeOps(std::mt19937& random) {
+    std::vector<PointOp> ops;
+    for (const FilterPtr& filter : {CreateGrayscaleFilter(), CreateSepiaFilter(), CreateNegativeFilter()}) {
+        ops.push_back(*filter->GetPointOp());
+    }
+    ops.push_back({{{1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}}, {0.0f, 0.0f, 0.0f}, true});
+    std::uniform_real_distribution<float> coefficient(-1.5f, 1.5f);
+    for (bool quantize : {false, true}) {
+        PointOp op{};
+        for (size_t c = 0; c < 3; ++c) {
+            for (size_t k = 0; k < 3; ++k) {
+                op.matrix[c][k] = coefficient(random);
+            }
+            op.offset[c] = coefficient(random);
+        }
+        op.quantize = quantize;
+        ops.push_back(op);
+    }
+    return ops;
+}
+
+// Feeds the values as all three channels, rotated against each other, at every count up to
+// KMaxTailCount and at the full length, so both the vector body and the tail are covered.
+bool Matches(const PointOp& op, const std::vector<float>& values, bool in_place) {
+    const size_t size = values.size();
+    std::vector<float> src(3 * size);
+    for (size_t i = 0; i < size; ++i) {
+        src[i] = values[i];
+        src[size + i] = values[(i + size / 3) % size];
+        src[2 * size + i] = values[(i + 2 * size / 3) % size];
+    }
+
+    std::vector<size_t> counts;
+    for (size_t count = 1; count <= KMaxTailCount && count <= size; ++count) {
+        counts.push_back(count);
+    }
+    counts.push_back(size);
+
+    for (size_t count : counts) {
+        std::vector<float> expected(3 * size);
+        std::vector<float> actual = in_place ? src : std::vector<float>(3 * size);
+        const point_kernels::ConstRows rows = {src.data(), src.data() + size, src.data() + 2 * size};
+        point_kernels::scalar::ApplyPointOp(
+            op, rows, {expected.data(), expected.data() + size, expected.data() + 2 * size}, count);
+        const point_kernels::ConstRows input =
+            in_place ? point_kernels::ConstRows{actual.data(), actual.data() + size, actual.data() + 2 * size} : rows;
+        point_kernels::ApplyPointOp(op, input, {actual.data(), actual.data() + size, actual.data() + 2 * size},
+                                    count);
+        for (size_t c = 0; c < 3; ++c) {
+            if (std::memcmp(expected.data() + c * size, actual.data() + c * size, count * sizeof(float)) != 0) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+using Rgb = std::array<float, 3>;
+
+Rgb Clamp(Rgb p) {
+    for (float& v : p) {
+        v = std::min(1.0f, std::max(0.0f, v));
+    }
+    return p;
+}
+
+Rgb ReferenceGrayscale(const Rgb& p) {
+    const float gray = std::clamp(0.299f * p[0] + 0.587f * p[1] + 0.114f * p[2], 0.0f, 1.0f);
+    return {gray, gray, gray};
+}
+
+Rgb ReferenceSepia(const Rgb& p) {
+    return Clamp({0.393f * p[0] + 0.769f * p[1] + 0.189f * p[2], 0.349f * p[0] + 0.686f * p[1] + 0.168f * p[2],
+                  0.272f * p[0] + 0.534f * p[1] + 0.131f * p[2]});
+}
+
+Rgb ReferenceNegative(const Rgb& p) {
+    Rgb out;
+    for (size_t c = 0; c < 3; ++c) {
+        out[c] = std::round((1.0f - p[c]) * KMaxColorValue) / KMaxColorValue;
+    }
+    return Clamp(out);
+}
+
+// Applies the filter to a one-row planar image of the values, rotated against each other per
+// channel, and compares every channel with the reference formula.
+bool MatchesReference(const FilterPtr& filter, Rgb (*reference)(const Rgb&), const std::vector<float>& values) {
+    const size_t size = values.size();
+    Image image = Image::CreateUninitialized(size, 1);
+    for (size_t x = 0; x < size; ++x) {
+        for (size_t c = 0; c < 3; ++c) {
+            image.ChannelRow(c, 0)[x] = values[(x + c * size / 3) % size];
+        }
+    }
+    const Image source = image;
+    filter->Apply(image);
+    for (size_t x = 0; x < size; ++x) {
+        const Rgb expected =
+            reference({source.ChannelRow(0, 0)[x], source.ChannelRow(1, 0)[x], source.ChannelRow(2, 0)[x]});
+        for (size_t c = 0; c < 3; ++c) {
+            if (std::memcmp(&expected[c], image.ChannelRow(c, 0) + x, sizeof(float)) != 0) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+}  // namespace
+
+int main() {
+    std::mt19937 random(KSeed);
+    const std::vector<std::vector<float>> inputs = {MakeEdgeValues(), MakeRandomValues(random)};
+    const std::vector<PointOp> ops = MakeOps(random);
+
+    size_t failures = 0;
+    for (size_t o = 0; o < ops.size(); ++o) {
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            for (bool in_place : {false, true}) {
+                if (!Matches(ops[o], inputs[i], in_place)) {
+                    std::cerr << "Mismatch: op " << o << ", input set " << i << (in_place ? ", in place" : "") << "\n";
+                    ++failures;
+                }
+            }
+        }
+    }
+
+    const std::pair<FilterPtr, Rgb (*)(const Rgb&)> filters[] = {{CreateGrayscaleFilter(), ReferenceGrayscale},
+                                                                  {CreateSepiaFilter(), ReferenceSepia},
+                                                                  {CreateNegativeFilter(), ReferenceNegative}};
+    for (const auto& [filter, reference] : filters) {
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            if (!MatchesReference(filter, reference, inputs[i])) {
+                std::cerr << "Mismatch: " << filter->GetName() << " against its formula, input set " << i << "\n";
+                ++failures;
+            }
+        }
+    }
+    std::cout << point_kernels::GetInstructionSet() << ": "
+              << (failures == 0 ? "identical to scalar and the filter formulas" : "FAILED") << "\n";
+    return failures == 0 ? 0 : 1;
+}
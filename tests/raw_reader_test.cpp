@@ -0,0 +1,124 @@
+#include "image.h"
+#include "posix_file.h"
+#include "raw_image.h"
+#include "reader.h"
+#include "writer.h"
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Feeds the raw reader headers that lie about the data behind them. Each has to be refused with
+// an error before anything is mapped; sizes that wrap around used to map a few bytes and let
+// the filters run far past them.
+
+namespace {
+constexpr uint64_t KWrappingWidth = (uint64_t{1} << 62) + 16;
+
+struct Case {
+    std::string name;
+    // Bytes of the file, written as is.
+    std::vector<char> bytes;
+};
+
+raw_image::Header MakeHeader(uint64_t width, uint64_t height, PixelFormat format) {
+    raw_image::Header header{};
+    std::memcpy(header.magic, raw_image::KMagic, sizeof(header.magic));
+    header.version = raw_image::KVersion;
+    header.format = static_cast<uint32_t>(format);
+    header.width = width;
+    header.height = height;
+    header.row_bytes = Image::GetRowBytes(width, PixelLayout::Planar, format);
+    header.data_offset = raw_image::KDataOffset;
+    return header;
+}
+
+// The header padded to the data offset, followed by data_bytes zero bytes.
+std::vector<char> MakeFile(const raw_image::Header& header, size_t data_bytes) {
+    std::vector<char> bytes(raw_image::KDataOffset + data_bytes);
+    std::memcpy(bytes.data(), &header, sizeof(header));
+    return bytes;
+}
+
+bool Equal(const Image& first, const Image& second) {
+    if (first.GetWidth() != second.GetWidth() || first.GetHeight() != second.GetHeight()) {
+        return false;
+    }
+    for (size_t c = 0; c < Image::KChannels; ++c) {
+        for (size_t y = 0; y < first.GetHeight(); ++y) {
+            if (std::memcmp(first.ChannelRow(c, y), second.ChannelRow(c, y), first.GetWidth() * sizeof(float)) != 0) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool Rejects(const std::string& path, bool rows) {
+    try {
+        if (rows) {
+            reader::GetRawRowReader(path);
+        } else {
+            reader::GetRawReader(path)->GetImage();
+        }
+    } catch (const std::runtime_error&) {
+        return true;
+    }
+    return false;
+}
+}  // namespace
+
+int main() {
+    const std::filesystem::path dir = std::filesystem::temp_directory_path();
+    const std::string path = MakeTemporaryPath((dir / "raw_reader_test.raw").string());
+
+    // A well-formed file has to still read back, or the cases below prove nothing.
+    Image image = Image::CreateUninitialized(5, 3);
+    for (size_t c = 0; c < Image::KChannels; ++c) {
+        for (size_t y = 0; y < image.GetHeight(); ++y) {
+            for (size_t x = 0; x < image.GetWidth(); ++x) {
+                image.ChannelRow(c, y)[x] = static_cast<float>(c + y + x) / 16;
+            }
+        }
+    }
+    writer::GetRawWriter(path)->Write(image);
+    bool ok = !Rejects(path, false) && !Rejects(path, true) && Equal(reader::GetRawReader(path)->GetImage(), image);
+    if (!ok) {
+        std::cout << "valid file: not read back FAILED\n";
+    }
+
+    const raw_image::Header valid = MakeHeader(5, 3, PixelFormat::Float32);
+    raw_image::Header wrapping = MakeHeader(KWrappingWidth, 1, PixelFormat::Float32);
+    wrapping.row_bytes = 64;
+    const raw_image::Header widest = MakeHeader(INT32_MAX, INT32_MAX, PixelFormat::Float32);
+    const raw_image::Header too_wide = MakeHeader(uint64_t{INT32_MAX} + 1, 1, PixelFormat::UInt8);
+    raw_image::Header past_end = valid;
+    past_end.data_offset = UINT64_MAX - raw_image::KDataOffset + 1;
+
+    const std::vector<char> whole = MakeFile(valid, 3 * 3 * valid.row_bytes);
+    const Case cases[] = {
+        {"empty file", {}},
+        {"truncated header", std::vector<char>(whole.begin(), whole.begin() + sizeof(raw_image::Header) - 1)},
+        {"truncated planes", std::vector<char>(whole.begin(), whole.end() - 1)},
+        {"width wrapping the row size", MakeFile(wrapping, 3 * 64)},
+        {"planes wrapping the file size", MakeFile(widest, 0)},
+        {"width above INT32_MAX", MakeFile(too_wide, 0)},
+        {"data offset wrapping the file size", MakeFile(past_end, 0)},
+    };
+    for (const Case& test : cases) {
+        std::ofstream(path, std::ios::binary | std::ios::trunc).write(test.bytes.data(), test.bytes.size());
+        for (const bool rows : {false, true}) {
+            if (!Rejects(path, rows)) {
+                std::cout << test.name << ": accepted by the " << (rows ? "row " : "") << "reader FAILED\n";
+                ok = false;
+            }
+        }
+    }
+    std::filesystem::remove(path);
+    std::cout << std::size(cases) << " malformed files checked\n";
+    return ok ? 0 : 1;
+}